@@ -7,14 +7,35 @@
 #include <cstring>
 #include <string>
 #include <sstream>
+#include <iomanip>
 #include <vector>
 #include <cassert>
 #include <regex>
 #include <cstdlib>
 #include <memory>
+#include <map>
+#include <sys/stat.h>
 
 #include <cstdint>
 #include <utility>
+#include <algorithm>
+#include <tuple>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <new>
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#endif
 
 namespace ffmpegcv {
 
@@ -46,6 +67,102 @@ namespace ffmpegcv {
 #endif
     }
 
+#ifndef _WIN32
+    // popen(command, "r") that also gives the pid of the command: the shell execs it, so that it can be killed
+    // while a reader is blocked on the pipe. With stderr_fd the command's stderr goes to a second pipe whose
+    // read end is returned there. Close with PCLOSE_PID().
+    FILE* POPEN_R_PID(const char* command, pid_t& pid, int* stderr_fd = NULL) {
+        int fds[2], err[2] = {-1, -1};
+        if (pipe(fds) < 0) return NULL;
+        if (stderr_fd && pipe(err) < 0) {
+            ::close(fds[0]);
+            ::close(fds[1]);
+            return NULL;
+        }
+        for (int fd : {fds[0], fds[1], err[0], err[1]}) {
+            if (fd >= 0) fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+
+        // nothing may allocate between fork and exec
+        const std::string exec_command = std::string("exec ") + command;
+        pid = fork();
+        if (pid == 0) {
+            dup2(fds[1], STDOUT_FILENO);
+            if (err[1] >= 0) dup2(err[1], STDERR_FILENO);
+            execl("/bin/sh", "sh", "-c", exec_command.c_str(), (char*)NULL);
+            _exit(127);
+        }
+        ::close(fds[1]);
+        if (err[1] >= 0) ::close(err[1]);
+        if (pid < 0) {
+            ::close(fds[0]);
+            if (err[0] >= 0) ::close(err[0]);
+            return NULL;
+        }
+        if (stderr_fd) *stderr_fd = err[0];
+        return fdopen(fds[0], "r");
+    }
+
+    int PCLOSE_PID(FILE* fp, pid_t pid) {
+        fclose(fp);
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {;}
+        return status;
+    }
+#endif
+
+    // Frames go straight between the caller's buffer and the pipe: no stdio buffer, and on Linux a
+    // pipe large enough for a whole frame (capped by /proc/sys/fs/pipe-max-size). Call before any I/O.
+    void PIPE_SETUP(FILE* fp, int bytes_per_frame) {
+#ifndef _WIN32
+        setvbuf(fp, NULL, _IONBF, 0);
+#ifdef F_SETPIPE_SZ
+        int fd = fileno(fp);
+        if (fcntl(fd, F_GETPIPE_SZ) < bytes_per_frame && fcntl(fd, F_SETPIPE_SZ, bytes_per_frame) < 0) {
+            std::ifstream max_file("/proc/sys/fs/pipe-max-size");
+            int max_size = 0;
+            if (max_file >> max_size && max_size > 0) {
+                fcntl(fd, F_SETPIPE_SZ, std::min(bytes_per_frame, max_size));
+            }
+        }
+#endif
+#else
+        (void)fp; (void)bytes_per_frame;
+#endif
+    }
+
+    size_t PIPE_READ(FILE* fp, void* buffer, size_t size) {
+#ifdef _WIN32
+        return fread(buffer, sizeof(char), size, fp);
+#else
+        int fd = fileno(fp);
+        size_t done = 0;
+        while (done < size) {
+            ssize_t n = ::read(fd, static_cast<char*>(buffer) + done, size - done);
+            if (n > 0) done += n;
+            else if (n < 0 && errno == EINTR) continue;
+            else break;
+        }
+        return done;
+#endif
+    }
+
+    size_t PIPE_WRITE(FILE* fp, const void* buffer, size_t size) {
+#ifdef _WIN32
+        return fwrite(buffer, sizeof(char), size, fp);
+#else
+        int fd = fileno(fp);
+        size_t done = 0;
+        while (done < size) {
+            ssize_t n = ::write(fd, static_cast<const char*>(buffer) + done, size - done);
+            if (n > 0) done += n;
+            else if (n < 0 && errno == EINTR) continue;
+            else break;
+        }
+        return done;
+#endif
+    }
+
     std::string get_file_extension(const std::string& filename);
     std::string execute_command(const std::string& command);
 
@@ -56,10 +173,12 @@ namespace ffmpegcv {
         int width = 0;
         int height = 0;
         int count = 0;
+        bool count_exact = true;   // false: `count` is estimated from duration * fps
         bool is_complex = false;
     };
 
     VideoInfo get_info(const std::string& filename);
+    int get_frame_count(const std::string& filename);
 
 //================ End Video info ==================
 
@@ -159,6 +278,7 @@ namespace ffmpegcv {
         int origin_width = 0;
         int origin_height = 0;
         int count = 0;
+        bool count_exact = true;
         int iframe = -1;
         float fps = 0;
         float duration = 0;
@@ -177,18 +297,239 @@ namespace ffmpegcv {
 
 
 
+    // With latest_frame_only a decoder thread drains the pipe continuously and keeps only the newest
+    // frame in a triple buffer, so read() returns the freshest frame instead of the oldest queued one.
+    // Frames the consumer was too slow to pick up are counted in dropped_frames; iframe is the
+    // decoder's index of the returned frame. Local files are paced with -re to stand in for a camera.
     class VideoCaptureStreamRT: public VideoCapture {
     public:
         VideoCaptureStreamRT();
         VideoCaptureStreamRT(const std::string& filename, int isColor = true,
-                             std::tuple<int, int, int, int> crop_xywh = {0, 0, 0, 0}, Size_wh resize = Size_wh(0,0));
+                             std::tuple<int, int, int, int> crop_xywh = {0, 0, 0, 0}, Size_wh resize = Size_wh(0,0),
+                             bool latest_frame_only = false);
 
         VideoCaptureStreamRT(const std::string& filename, std::string pix_fmt,
-                             std::tuple<int, int, int, int> crop_xywh = {0, 0, 0, 0}, Size_wh resize = Size_wh(0,0));
+                             std::tuple<int, int, int, int> crop_xywh = {0, 0, 0, 0}, Size_wh resize = Size_wh(0,0),
+                             bool latest_frame_only = false);
+
+        ~VideoCaptureStreamRT();
+        void initializer() override;
+        void release() override;
+        bool read(void * frame) override;
+        using VideoCapture::read;
+
+    public:
+        bool latest_frame_only = false;
+        std::atomic<long long> dropped_frames{0};
+
+    private:
+        void decoder_f();
+
+        // state = index of the shared buffer | DIRTY when it holds a frame not yet taken by read().
+        // The decoder owns back, the reader owns front; buffers only change hands by exchanging state.
+        static constexpr int DIRTY = 4;
+        std::vector<uint8_t> buffers[3];
+        int buffer_index[3] = {-1, -1, -1};
+        std::atomic<int> state{1};
+        int front = 0;
+        int back = 2;
+        int iframe_decoded = -1;
+
+        std::atomic<bool> eof{false};
+        std::atomic<bool> stop{false};
+        std::mutex mtx;                 // only for the wakeup of read(), never held while copying
+        std::condition_variable cv;
+        std::thread decoder;
+#ifndef _WIN32
+        pid_t child = -1;               // ffmpeg, killed by release() to unblock the decoder
+#endif
+    };
 
+#ifndef _WIN32
+    // A VideoCapture that also reports the presentation time of every frame it returns. ffmpeg keeps the
+    // source timestamps (-copyts), passes every decoded frame through unchanged (-fps_mode passthrough)
+    // and logs it with showinfo on its stderr, which read() takes from a second pipe.
+    class VideoCapturePts: public VideoCapture {
+    public:
+        VideoCapturePts();
+        VideoCapturePts(const std::string& filename, std::string pix_fmt,
+                        std::tuple<int, int, int, int> crop_xywh = {0, 0, 0, 0}, Size_wh resize = Size_wh(0,0));
+
+        ~VideoCapturePts();
         void initializer() override;
+        void release() override;
+        bool read(void * frame) override;
+        using VideoCapture::read;
+
+    public:
+        double pts_time = NAN;          // seconds, of the frame last read; NAN if ffmpeg logged none
+
+    private:
+        double next_pts();
+
+        pid_t child = -1;
+        FILE* log = NULL;               // ffmpeg's stderr
+    };
+#endif
+
+//================Begin Multi Video Reader==================
+    // Reads N synchronized videos in lockstep, each decoded by its own worker thread.
+    // ALIGN_INDEX pairs the i-th frame of every file; ALIGN_PTS reads the source timestamps through
+    // VideoCapturePts and drops leading frames of the cameras that are behind so that all frames of
+    // one read() lie within half a frame interval (POSIX only).
+    class MultiVideoCapture {
+    public:
+        enum Align { ALIGN_INDEX = 0, ALIGN_PTS = 1 };
+
+        MultiVideoCapture();
+        MultiVideoCapture(const std::vector<std::string>& filenames, std::string pix_fmt = "bgr24",
+                          std::tuple<int, int, int, int> crop_xywh = {0, 0, 0, 0}, Size_wh resize = Size_wh(0,0),
+                          Align align = ALIGN_INDEX, int queue_size = 4);
+        ~MultiVideoCapture();
+        void release();
+        void close();
+        uint8_t* getBuffer();
+        bool read(void * stacked);                        // N * bytes_per_frame, camera-major
+        bool read(std::vector<void *>& frames);           // one buffer per camera
+        std::tuple<bool, std::vector<void *>> read();
+        bool isOpened();
+        int size();
+        int len();
+
+    public:
+        std::vector<std::string> filenames;
+        std::string pix_fmt = "bgr24";
+        Align align = ALIGN_INDEX;
+        int queue_size = 4;
+        int ncams = 0;
+        int bytes_per_frame = 0;
+        int width = 0;
+        int height = 0;
+        int count = 0;
+        bool count_exact = false;
+        int iframe = -1;
+        float fps = 0;
+        bool waitInit = true;
+        void* default_buffer = NULL;
+        Size_wh size_wh = Size_wh(0, 0);
+        std::vector<int> outnumpyshape;                   // {N, ...single frame shape}
+
+    private:
+        struct Worker {
+            std::unique_ptr<VideoCapture> cap;
+            std::vector<std::vector<uint8_t>> slots;
+            std::vector<double> slot_pts;
+            size_t head = 0;
+            size_t filled = 0;
+            bool eof = false;
+            bool stop = false;
+            std::mutex mtx;
+            std::condition_variable cv;
+            std::thread thread;
+        };
+
+        void start();
+        void worker_f(Worker& w);
+        bool wait_head(Worker& w);
+        void pop_head(Worker& w);
+        double head_time(Worker& w);
+
+        std::vector<std::unique_ptr<Worker>> workers;
+    };
+//================End Multi Video Reader==================
+
+#ifndef _WIN32
+//================Begin Shared Memory Frame Ring==================
+    // One process decodes, any number of processes read the frames from a POSIX shared-memory ring.
+    // Layout: ShmRingHeader, then nslots x (ShmSlotHeader + frame), each part 64-byte aligned.
+    // Every slot is a seqlock: seq is odd while the publisher writes it and 2 * frame_index + 2 once the
+    // frame is complete, so a reader validates its copy by reading seq before and after.
+    struct ShmRingHeader {
+        std::atomic<uint32_t> magic;        // written last by the publisher
+        uint32_t version;
+        int32_t width;
+        int32_t height;
+        int32_t bytes_per_frame;
+        int32_t nslots;
+        int64_t slot_stride;
+        float fps;
+        char pix_fmt[16];
+        std::atomic<uint64_t> write_seq;    // frames published so far
+        std::atomic<uint32_t> closed;       // publisher has finished
+        int32_t publisher_pid;              // readers give up once this process is gone
+    };
+
+    struct ShmSlotHeader {
+        std::atomic<uint64_t> seq;
+    };
+
+    // an atomic that takes a lock keeps it in the process, not in the shared memory
+    static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+                  "the frame ring needs lock-free 32 and 64-bit atomics");
+
+    // Decodes with any VideoCapture straight into the ring. Readers may attach and detach at any time.
+    // A segment of the same name left by a publisher that died is replaced; while its publisher is still
+    // running, isOpened() is false and errno is EEXIST. The name must be a valid shm_open name ("/cam0").
+    class ShmFramePublisher {
+    public:
+        ShmFramePublisher();
+        ShmFramePublisher(const std::string& name, std::unique_ptr<VideoCapture> cap, int nslots = 8);
+        ~ShmFramePublisher();
+        bool publish();       // decode and publish one frame, false at the end of the stream
+        int run();            // publish until the end of the stream, returns the number of frames
+        void release();
+        void close();
+        bool isOpened();
+
+    public:
+        std::string name = "";
+        std::unique_ptr<VideoCapture> cap;
+        int nslots = 8;
+        int iframe = -1;
+
+    private:
+        ShmRingHeader* header = NULL;
+        size_t map_size = 0;
     };
 
+    // Attaches to a ring created by ShmFramePublisher and starts at its newest frame. Frames that were
+    // overwritten before this reader got to them are skipped and counted in dropped_frames. read() returns
+    // false once the publisher has closed the ring or its process has died; it must run in the same pid
+    // namespace as the reader, and as the same user since the ring is mapped read-write.
+    class VideoCaptureShm {
+    public:
+        VideoCaptureShm();
+        VideoCaptureShm(const std::string& name, int timeout_ms = 5000);
+        ~VideoCaptureShm();
+        void release();
+        void close();
+        uint8_t* getBuffer();
+        bool read(void * frame);
+        std::tuple<bool, void *> read();
+        bool isOpened();
+
+    public:
+        std::string name = "";
+        std::string pix_fmt = "";
+        int bytes_per_frame = 0;
+        int width = 0;
+        int height = 0;
+        int iframe = -1;
+        float fps = 0;
+        long long dropped_frames = 0;
+        void* default_buffer = NULL;
+        Size_wh size_wh = Size_wh(0, 0);
+        std::vector<int> outnumpyshape;
+
+    private:
+        const ShmRingHeader* header = NULL;
+        size_t map_size = 0;
+        uint64_t next = 0;
+        bool attached = false;
+    };
+//================End Shared Memory Frame Ring==================
+#endif
+
     std::tuple<Size_wh, Size_wh, std::string, std::string> get_videofilter_gpu(
             Size_wh originsize, std::string pix_fmt, std::tuple<int, int, int, int> crop_xywh, Size_wh resize);
     int get_num_NVIDIA_GPUs();
@@ -272,31 +613,216 @@ namespace ffmpegcv{
         return file.good();
     }
 
-    VideoInfo get_info(const std::string& filename) {
-        assert (file_exsits(filename) && "File does not exist");
-        static const std::vector<std::string> complex_formats = {"mkv", "flv", "ts"};
-        const bool is_complex = std::find(complex_formats.begin(), complex_formats.end(),
-                                          get_file_extension(filename)) != complex_formats.end();
+    // On-disk probe cache, one tab separated line per file:
+    //   path size mtime codec width height fps duration count count_exact
+    // keyed by (canonical path, size, mtime). New files are appended; when an entry changes (e.g. the
+    // exact frame count) or the file holds duplicates, it is rewritten. Set FFMPEGCV_PROBE_CACHE to
+    // choose the file, or to "" to disable it.
+    class ProbeCache {
+    public:
+        static ProbeCache& instance() {
+            static ProbeCache cache;
+            return cache;
+        }
 
+        static bool is_complex_format(const std::string& filename) {
+            static const std::vector<std::string> complex_formats = {"mkv", "flv", "ts"};
+            return std::find(complex_formats.begin(), complex_formats.end(),
+                             get_file_extension(filename)) != complex_formats.end();
+        }
+
+        bool lookup(const std::string& filename, VideoInfo& info) {
+            std::lock_guard<std::mutex> lock(mtx);
+            Key key;
+            if (!make_key(filename, key)) return false;
+            load();
+            auto it = entries.find(canonical(filename));
+            if (it == entries.end() || it->second.first != key) return false;
+            info = it->second.second;
+            return true;
+        }
+
+        void store(const std::string& filename, const VideoInfo& info) {
+            std::lock_guard<std::mutex> lock(mtx);
+            Key key;
+            if (!make_key(filename, key)) return;
+            load();
+            const std::string name = canonical(filename);
+            if (name.find_first_of("\t\n") != std::string::npos) return;
+            const bool replaced = entries.count(name) != 0;
+            entries[name] = {key, info};
+            if (path.empty()) return;
+
+            if (!replaced && lines == entries.size() - 1) {
+                std::ofstream out(path, std::ios::app);
+                write_line(out, name, entries[name]);
+                lines++;
+                return;
+            }
+
+            // the whole file goes through a temporary one, so that a reader never sees half of it
+            const std::string tmp = path + ".tmp";
+            {
+                std::ofstream out(tmp, std::ios::trunc);
+                for (const auto& entry : entries) write_line(out, entry.first, entry.second);
+                if (!out) return;
+            }
+            std::remove(path.c_str());      // rename() does not replace on Windows
+            if (std::rename(tmp.c_str(), path.c_str()) == 0) lines = entries.size();
+        }
+
+    private:
+        using Key = std::pair<long long, long long>;   // size, mtime
+
+        ProbeCache() {
+            const char* env = std::getenv("FFMPEGCV_PROBE_CACHE");
+#ifdef _WIN32
+            const char* home = std::getenv("LOCALAPPDATA");
+#else
+            const char* home = std::getenv("HOME");
+#endif
+            if (env) path = env;
+            else if (home) path = std::string(home) + "/.ffmpegcv_probe_cache";
+        }
+
+        // absolute, with symlinks and "." / ".." resolved, so that every spelling of a path shares one entry
+        static std::string canonical(const std::string& filename) {
+#ifdef _WIN32
+            char resolved[_MAX_PATH];
+            return _fullpath(resolved, filename.c_str(), _MAX_PATH) ? std::string(resolved) : filename;
+#else
+            char* resolved = realpath(filename.c_str(), nullptr);
+            if (!resolved) return filename;
+            std::string name(resolved);
+            free(resolved);
+            return name;
+#endif
+        }
+
+        // fps and duration with enough digits to read back the same float, e.g. 30000/1001
+        static void write_line(std::ostream& out, const std::string& filename, const std::pair<Key, VideoInfo>& entry) {
+            const Key& key = entry.first;
+            const VideoInfo& info = entry.second;
+            out << filename << '\t' << key.first << '\t' << key.second << '\t'
+                << (info.codec.empty() ? "-" : info.codec) << '\t' << info.width << '\t' << info.height << '\t'
+                << std::setprecision(std::numeric_limits<float>::max_digits10)
+                << info.fps << '\t' << info.duration << '\t' << info.count << '\t' << info.count_exact << '\n';
+        }
+
+        static bool make_key(const std::string& filename, Key& key) {
+            struct stat st;
+            if (stat(filename.c_str(), &st) != 0) return false;
+            key = {(long long)st.st_size, (long long)st.st_mtime};
+            return true;
+        }
+
+        void load() {
+            if (loaded) return;
+            loaded = true;
+            if (path.empty()) return;
+
+            std::ifstream in(path);
+            std::string line;
+            while (std::getline(in, line)) {
+                std::istringstream fields(line);
+                std::string filename;
+                Key key;
+                VideoInfo info;
+                if (!std::getline(fields, filename, '\t')) continue;
+                lines++;
+                if (fields >> key.first >> key.second >> info.codec >> info.width >> info.height
+                           >> info.fps >> info.duration >> info.count >> info.count_exact) {
+                    if (info.codec == "-") info.codec.clear();
+                    info.is_complex = is_complex_format(filename);
+                    entries[canonical(filename)] = {key, info};    // later lines win
+                }
+            }
+        }
+
+        std::mutex mtx;
+        std::string path;
+        bool loaded = false;
+        size_t lines = 0;       // in the file, more than entries.size() if it holds duplicates
+        std::map<std::string, std::pair<Key, VideoInfo>> entries;
+    };
+
+    // The container frame count is unreliable for mkv/flv/ts, so only estimate it here;
+    // the exact count is computed on demand by get_frame_count().
+    void estimate_count(VideoInfo& info) {
+        if (info.count <= 0 || info.is_complex) {
+            info.count = int(info.duration * info.fps + 0.5f);
+            info.count_exact = false;
+        }
+    }
+
+#ifdef AVFORMAT_AVFORMAT_H
+    // in-process probe, same fields as the ffprobe one below
+    VideoInfo probe_info(const std::string& filename) {
+        VideoInfo info;
+        info.is_complex = ProbeCache::is_complex_format(filename);
+
+        AVFormatContext* fmt_ctx = nullptr;
+        if (avformat_open_input(&fmt_ctx, filename.c_str(), nullptr, nullptr) < 0) return info;
+
+        if (avformat_find_stream_info(fmt_ctx, nullptr) >= 0) {
+            int index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+            if (index >= 0) {
+                const AVStream* stream = fmt_ctx->streams[index];
+                info.codec = avcodec_get_name(stream->codecpar->codec_id);
+                info.width = stream->codecpar->width;
+                info.height = stream->codecpar->height;
+                info.count = int(stream->nb_frames);
+                if (stream->r_frame_rate.den != 0) info.fps = float(av_q2d(stream->r_frame_rate));
+                info.duration = stream->duration != AV_NOPTS_VALUE ?
+                                float(stream->duration * av_q2d(stream->time_base)) :
+                                float(fmt_ctx->duration / (double)AV_TIME_BASE);
+            }
+        }
+        avformat_close_input(&fmt_ctx);
+
+        estimate_count(info);
+        return info;
+    }
+
+    int count_frames(const std::string& filename) {
+        AVFormatContext* fmt_ctx = nullptr;
+        if (avformat_open_input(&fmt_ctx, filename.c_str(), nullptr, nullptr) < 0) return 0;
+
+        int count = 0;
+        int index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (index >= 0) {
+            // demux only, skipping the packets of every other stream
+            for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+                if (int(i) != index) fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+            }
+            AVPacket* packet = av_packet_alloc();
+            while (av_read_frame(fmt_ctx, packet) >= 0) {
+                if (packet->stream_index == index) count++;
+                av_packet_unref(packet);
+            }
+            av_packet_free(&packet);
+        }
+        avformat_close_input(&fmt_ctx);
+        return count;
+    }
+#else
+    VideoInfo probe_info(const std::string& filename) {
         std::ostringstream cmd;
         cmd << "ffprobe -v quiet -print_format json=compact=1 -select_streams v:0";
-        if (is_complex) cmd << " -count_packets";
         cmd << " -show_streams \"" << filename << "\"";
 
         const std::string json_output = execute_command(cmd.str());
         VideoInfo info;
-        info.is_complex = is_complex;
+        info.is_complex = ProbeCache::is_complex_format(filename);
 
         static const std::regex codec_re( "codec_name.: .(\\w+)");
         static const std::regex width_re( "width.: (\\d+)");
         static const std::regex height_re( "height.: (\\d+)");
         static const std::regex frames_re( "nb_frames.: .(\\d+)");
-        static const std::regex nb_read_packets_re( "nb_read_packets.: .(\\d+)");
         static const std::regex duration_re( "duration.: .([0-9]*\\.?[0-9]+)");
         static const std::regex rate_re( "r_frame_rate.: .(\\d+)/(\\d+)");
 
         std::smatch match;
-        auto count_re = is_complex? nb_read_packets_re : frames_re;
 
         if (std::regex_search(json_output, match, codec_re) && match.size() > 1) {
             info.codec = match[1];
@@ -310,7 +836,7 @@ namespace ffmpegcv{
             info.height = std::stoi(match[1]);
         }
 
-        if (std::regex_search(json_output, match, count_re) && match.size() > 1) {
+        if (std::regex_search(json_output, match, frames_re) && match.size() > 1) {
             info.count = std::stoi(match[1]);
         }
 
@@ -324,9 +850,66 @@ namespace ffmpegcv{
             if (den != 0) info.fps = float(num) / den;
         }
 
+        estimate_count(info);
         return info;
     }
 
+    int count_frames(const std::string& filename) {
+        std::ostringstream cmd;
+        cmd << "ffprobe -v quiet -select_streams v:0 -count_packets"
+            << " -show_entries stream=nb_read_packets -of csv=p=0 \"" << filename << "\"";
+        return std::atoi(execute_command(cmd.str()).c_str());
+    }
+#endif
+
+    VideoInfo get_info(const std::string& filename) {
+        assert (file_exsits(filename) && "File does not exist");
+
+        VideoInfo info;
+        if (ProbeCache::instance().lookup(filename, info)) return info;
+
+        info = probe_info(filename);
+        if (info.width > 0 && info.height > 0) ProbeCache::instance().store(filename, info);
+        return info;
+    }
+
+    int get_frame_count(const std::string& filename) {
+        VideoInfo info = get_info(filename);
+        if (info.count_exact) return info.count;
+
+        info.count = count_frames(filename);
+        info.count_exact = true;
+        ProbeCache::instance().store(filename, info);
+        return info.count;
+    }
+
+#ifdef AVFORMAT_AVFORMAT_H
+    VideoInfo get_info_stream(const std::string& filename, int timeout=0, int duration_ms=100){
+        VideoInfo info;
+        AVDictionary* options = nullptr;
+        if (startsWith(filename, "rtsp://")) av_dict_set(&options, "rtsp_flags", "prefer_tcp", 0);
+        if (timeout > 0) av_dict_set(&options, "timeout", std::to_string(timeout * 1000000LL).c_str(), 0);
+
+        AVFormatContext* fmt_ctx = avformat_alloc_context();
+        fmt_ctx->max_analyze_duration = duration_ms * 1000LL;
+        int ret = avformat_open_input(&fmt_ctx, filename.c_str(), nullptr, &options);
+        av_dict_free(&options);
+        if (ret < 0) return info;
+
+        if (avformat_find_stream_info(fmt_ctx, nullptr) >= 0) {
+            int index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+            if (index >= 0) {
+                const AVStream* stream = fmt_ctx->streams[index];
+                info.codec = avcodec_get_name(stream->codecpar->codec_id);
+                info.width = stream->codecpar->width;
+                info.height = stream->codecpar->height;
+                if (stream->r_frame_rate.den != 0) info.fps = float(av_q2d(stream->r_frame_rate));
+            }
+        }
+        avformat_close_input(&fmt_ctx);
+        return info;
+    }
+#else
     VideoInfo get_info_stream(const std::string& filename, int timeout=0, int duration_ms=100){
         std::string rtsp_opt = startsWith(filename, "rtsp://") ? "-rtsp_flags prefer_tcp -pkt_size 736 " : "";
         std::string analyze_duration = " -analyzeduration " + std::to_string(duration_ms) + "000 ";
@@ -366,6 +949,7 @@ namespace ffmpegcv{
 
         return info;
     }
+#endif
 //================ End Video info ==================
 
 //================ Begin Video Writer ==================
@@ -441,6 +1025,7 @@ namespace ffmpegcv{
     bool VideoWriter::write(const void* frame) {
         if (waitInit){
             process = POPEN_W(ffmpeg_cmd.c_str());
+            if (process) PIPE_SETUP(process, bytes_per_frame);
             waitInit = false;
         }
         if (frame == NULL) return false;
@@ -448,8 +1033,7 @@ namespace ffmpegcv{
             std::cerr << "Failed to open video writer";
             return false;
         }
-        fwrite(frame, sizeof(char), bytes_per_frame, process);
-        return true;
+        return PIPE_WRITE(process, frame, bytes_per_frame) == size_t(bytes_per_frame);
     }
 
 #ifdef OPENCV_CORE_TYPES_HPP
@@ -588,6 +1172,7 @@ namespace ffmpegcv{
         fps = videoinfo.fps;
         duration = videoinfo.duration;
         count = videoinfo.count;
+        count_exact = videoinfo.count_exact;
         iframe = -1;
         default_buffer = NULL;
         waitInit = true;
@@ -648,11 +1233,12 @@ namespace ffmpegcv{
     bool VideoCapture::read(void * frame) {
         if (waitInit){
             process = POPEN_R(ffmpeg_cmd.c_str());
+            if (process) PIPE_SETUP(process, bytes_per_frame);
             waitInit = false;
         }
 
         if (process) {
-            int bytesRead = fread(frame, sizeof(char), bytes_per_frame, process);
+            int bytesRead = int(PIPE_READ(process, frame, bytes_per_frame));
             if (bytesRead == bytes_per_frame) {
                 iframe += 1;
                 return true;
@@ -677,18 +1263,23 @@ namespace ffmpegcv{
     }
 
     const int VideoCapture::size() {
+        if (!count_exact) {
+            count = get_frame_count(filename);
+            count_exact = true;
+        }
         return count;
     }
 
     const int VideoCapture::len() {
-        return count;
+        return size();
     }
 
     VideoCaptureStreamRT::VideoCaptureStreamRT():VideoCapture(){;}
 
     VideoCaptureStreamRT::VideoCaptureStreamRT(const std::string& filename, int isColor,
-                                               std::tuple<int, int, int, int> crop_xywh, Size_wh resize):
-            VideoCapture(){
+                                               std::tuple<int, int, int, int> crop_xywh, Size_wh resize,
+                                               bool latest_frame_only):
+            VideoCapture(), latest_frame_only(latest_frame_only){
         this->filename = filename;
         this->crop_xywh = crop_xywh;
         this->resize = resize;
@@ -697,8 +1288,9 @@ namespace ffmpegcv{
     }
 
     VideoCaptureStreamRT::VideoCaptureStreamRT(const std::string& filename, std::string pix_fmt,
-                                               std::tuple<int, int, int, int> crop_xywh, Size_wh resize):
-            VideoCapture(){
+                                               std::tuple<int, int, int, int> crop_xywh, Size_wh resize,
+                                               bool latest_frame_only):
+            VideoCapture(), latest_frame_only(latest_frame_only){
         this->filename = filename;
         this->crop_xywh = crop_xywh;
         this->resize = resize;
@@ -706,6 +1298,10 @@ namespace ffmpegcv{
         initializer();
     }
 
+    VideoCaptureStreamRT::~VideoCaptureStreamRT() {
+        release();
+    }
+
     void VideoCaptureStreamRT::initializer() {
         VideoInfo videoinfo = get_info_stream(filename);
         origin_width = width = videoinfo.width;
@@ -729,10 +1325,12 @@ namespace ffmpegcv{
         height = size_wh.height;
 
         std::string rtsp_opt = startsWith(filename, "rtsp://") ? "-rtsp_flags prefer_tcp -pkt_size 736 " : "";
+        // a local file is read at its native rate so that it behaves like a live source
+        std::string rate_opt = latest_frame_only && filename.find("://") == std::string::npos ? "-re " : "";
 
         // 初始化 ffmpeg 的 VideoCapture
         std::ostringstream oss;
-        oss << "ffmpeg -y -loglevel warning " << rtsp_opt
+        oss << "ffmpeg -y -loglevel warning " << rtsp_opt << rate_opt
             << "-i \"" << filename << "\" -an -map 0:v -f rawvideo "
             << filterstr << " -pix_fmt " << pix_fmt << " pipe:";
 
@@ -747,6 +1345,679 @@ namespace ffmpegcv{
         }
     }
 
+    void VideoCaptureStreamRT::decoder_f() {
+        while (!stop) {
+            std::vector<uint8_t>& buffer = buffers[back];
+            if (PIPE_READ(process, buffer.data(), bytes_per_frame) != size_t(bytes_per_frame)) break;
+            buffer_index[back] = ++iframe_decoded;
+
+            // publish back, take over whatever was shared; if that was never read it is dropped
+            int prev = state.exchange(back | DIRTY, std::memory_order_acq_rel);
+            if (prev & DIRTY) dropped_frames++;
+            back = prev & ~DIRTY;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+            }
+            cv.notify_one();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            eof = true;
+        }
+        cv.notify_one();
+    }
+
+    bool VideoCaptureStreamRT::read(void * frame) {
+        if (!latest_frame_only) return VideoCapture::read(frame);
+
+        if (waitInit) {
+            waitInit = false;
+#ifdef _WIN32
+            process = POPEN_R(ffmpeg_cmd.c_str());
+#else
+            process = POPEN_R_PID(ffmpeg_cmd.c_str(), child);
+#endif
+            if (!process) return false;
+            PIPE_SETUP(process, bytes_per_frame);
+            for (auto& buffer : buffers) buffer.resize(bytes_per_frame);
+            decoder = std::thread(&VideoCaptureStreamRT::decoder_f, this);
+        }
+        if (!process) return false;
+
+        if (!(state.load(std::memory_order_acquire) & DIRTY)) {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [this] { return (state.load(std::memory_order_acquire) & DIRTY) || eof; });
+        }
+        if (!(state.load(std::memory_order_acquire) & DIRTY)) {
+            release();
+            return false;
+        }
+
+        front = state.exchange(front, std::memory_order_acq_rel) & ~DIRTY;
+        memcpy(frame, buffers[front].data(), bytes_per_frame);
+        iframe = buffer_index[front];
+        return true;
+    }
+
+    void VideoCaptureStreamRT::release() {
+        // the decoder is usually blocked reading the pipe, a stalled stream would keep it there forever;
+        // killing ffmpeg closes the pipe, so the read returns. Nothing is lost, the frames are raw.
+        stop = true;
+#ifndef _WIN32
+        if (child > 0) kill(child, SIGKILL);
+#endif
+        if (decoder.joinable()) decoder.join();
+#ifndef _WIN32
+        if (child > 0) {
+            if (process) PCLOSE_PID(process, child);
+            process = NULL;
+            child = -1;
+        }
+#endif
+        VideoCapture::release();
+    }
+
+#ifndef _WIN32
+    VideoCapturePts::VideoCapturePts(){;}
+
+    VideoCapturePts::VideoCapturePts(const std::string& filename, std::string pix_fmt,
+                                     std::tuple<int, int, int, int> crop_xywh, Size_wh resize):
+            VideoCapture(){
+        this->filename = filename;
+        this->crop_xywh = crop_xywh;
+        this->resize = resize;
+        this->pix_fmt = pix_fmt;
+        initializer();
+    }
+
+    VideoCapturePts::~VideoCapturePts() {
+        release();
+    }
+
+    void VideoCapturePts::initializer() {
+        VideoInfo videoinfo = get_info(filename);
+        origin_width = width = videoinfo.width;
+        origin_height = height = videoinfo.height;
+        codec = videoinfo.codec;
+        fps = videoinfo.fps;
+        duration = videoinfo.duration;
+        count = videoinfo.count;
+        count_exact = videoinfo.count_exact;
+        iframe = -1;
+        pts_time = NAN;
+        default_buffer = NULL;
+        waitInit = true;
+
+        assert(width % 2 == 0 && "Height must be even");
+        assert(height % 2 == 0 && "Width must be even");
+
+        std::tuple<Size_wh, Size_wh, std::string> filter_options = get_videofilter_cpu(
+                {width, height}, pix_fmt, crop_xywh, resize);
+        size_wh = std::get<1>(filter_options);
+        std::string filterstr = std::get<2>(filter_options);
+        filterstr = filterstr.empty() ? "-vf showinfo" : filterstr + ",showinfo";
+        width = size_wh.width;
+        height = size_wh.height;
+
+        // 日志带上级别以便区分 showinfo 与警告; passthrough: 每个 showinfo 行恰好对应一帧输出
+        std::ostringstream oss;
+        oss << "ffmpeg -y -hide_banner -nostats -loglevel level+info -copyts -i \"" << filename
+            << "\" -an -map 0:v:0 -fps_mode passthrough -f rawvideo " << filterstr << " -pix_fmt " << pix_fmt << " pipe:";
+        ffmpeg_cmd = oss.str();
+
+        // 计算每帧的位数
+        outnumpyshape = get_outnumpyshape(size_wh, pix_fmt);
+        bytes_per_frame = 1;
+        for (int num : outnumpyshape) {
+            bytes_per_frame *= num;
+        }
+    }
+
+    bool VideoCapturePts::read(void * frame) {
+        if (waitInit) {
+            waitInit = false;
+            int log_fd = -1;
+            process = POPEN_R_PID(ffmpeg_cmd.c_str(), child, &log_fd);
+            if (!process) return false;
+            PIPE_SETUP(process, bytes_per_frame);
+            log = fdopen(log_fd, "r");
+        }
+        if (!process) return false;
+
+        if (PIPE_READ(process, frame, bytes_per_frame) != size_t(bytes_per_frame)) {
+            release();
+            return false;
+        }
+        iframe += 1;
+        pts_time = next_pts();
+        return true;
+    }
+
+    // showinfo logs a frame before it is written to the pipe, so once the frame has been read its line is
+    // on the way and the blocking read below returns right away. Warnings and errors are passed on.
+    double VideoCapturePts::next_pts() {
+        char buffer[1024];
+        std::string line;
+        while (log && fgets(buffer, sizeof(buffer), log)) {
+            line += buffer;
+            if (line.back() != '\n') continue;
+
+            size_t pos = line.find("pts_time:");
+            if (line.find("showinfo") != std::string::npos && line.find(" n:") != std::string::npos &&
+                pos != std::string::npos) {
+                const char* begin = line.c_str() + pos + strlen("pts_time:");
+                char* end = NULL;
+                double pts = strtod(begin, &end);
+                return end != begin ? pts : NAN;
+            }
+            if (line.find("[warning]") != std::string::npos || line.find("[error]") != std::string::npos ||
+                line.find("[fatal]") != std::string::npos) {
+                std::cerr << line;
+            }
+            line.clear();
+        }
+        return NAN;
+    }
+
+    void VideoCapturePts::release() {
+        // ffmpeg may be blocked on either pipe when the reader stops early; the frames are raw, nothing is lost
+        if (child > 0) {
+            kill(child, SIGKILL);
+            if (log) fclose(log);
+            if (process) PCLOSE_PID(process, child);
+            process = NULL;
+            log = NULL;
+            child = -1;
+        }
+        VideoCapture::release();
+    }
+#endif
+
+    MultiVideoCapture::MultiVideoCapture(){;}
+
+    MultiVideoCapture::MultiVideoCapture(const std::vector<std::string>& filenames, std::string pix_fmt,
+                                         std::tuple<int, int, int, int> crop_xywh, Size_wh resize,
+                                         Align align, int queue_size):
+            filenames(filenames), pix_fmt(pix_fmt), align(align), queue_size(std::max(queue_size, 1)){
+        assert(!filenames.empty() && "No input files");
+        ncams = int(filenames.size());
+        for (const auto& filename : filenames) {
+            auto w = std::make_unique<Worker>();
+            if (align == ALIGN_PTS) {
+#ifndef _WIN32
+                w->cap = std::make_unique<VideoCapturePts>(filename, pix_fmt, crop_xywh, resize);
+#else
+                assert(!"ALIGN_PTS is not supported on Windows");
+#endif
+            } else {
+                w->cap = std::make_unique<VideoCapture>(filename, pix_fmt, crop_xywh, resize);
+            }
+            workers.push_back(std::move(w));
+        }
+
+        const VideoCapture& first = *workers[0]->cap;
+        size_wh = first.size_wh;
+        width = first.width;
+        height = first.height;
+        bytes_per_frame = first.bytes_per_frame;
+        fps = first.fps;
+        count = first.count;
+        for (const auto& w : workers) {
+            assert(w->cap->bytes_per_frame == bytes_per_frame && "All cameras must have the same output size");
+            count = std::min(count, w->cap->count);
+        }
+        count_exact = false;
+
+        outnumpyshape = {ncams};
+        outnumpyshape.insert(outnumpyshape.end(), first.outnumpyshape.begin(), first.outnumpyshape.end());
+    }
+
+    MultiVideoCapture::~MultiVideoCapture() {
+        release();
+    }
+
+    void MultiVideoCapture::start() {
+        for (auto& w : workers) {
+            w->slots.assign(queue_size, std::vector<uint8_t>(bytes_per_frame));
+            w->slot_pts.assign(queue_size, 0);
+            Worker* pw = w.get();
+            w->thread = std::thread([this, pw](){ worker_f(*pw); });
+        }
+    }
+
+    void MultiVideoCapture::worker_f(Worker& w) {
+        size_t tail = 0;
+        double last_pts = NAN;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(w.mtx);
+                w.cv.wait(lock, [&w, this](){ return w.stop || w.filled < size_t(queue_size); });
+                if (w.stop) return;
+            }
+
+            // the slot at tail is owned by this thread until `filled` is bumped
+            bool ok = w.cap->read(w.slots[tail].data());
+
+            std::lock_guard<std::mutex> lock(w.mtx);
+            if (!ok) {
+                w.eof = true;
+                w.cv.notify_all();
+                return;
+            }
+            // a frame without a logged timestamp is placed one interval after the previous one
+            double pts = NAN;
+#ifndef _WIN32
+            if (align == ALIGN_PTS) pts = static_cast<VideoCapturePts&>(*w.cap).pts_time;
+#endif
+            if (std::isnan(pts)) {
+                double interval = w.cap->fps > 0 ? 1 / double(w.cap->fps) : 1;
+                pts = std::isnan(last_pts) ? w.cap->iframe * interval : last_pts + interval;
+            }
+            w.slot_pts[tail] = last_pts = pts;
+            tail = (tail + 1) % queue_size;
+            w.filled++;
+            w.cv.notify_all();
+        }
+    }
+
+    bool MultiVideoCapture::wait_head(Worker& w) {
+        std::unique_lock<std::mutex> lock(w.mtx);
+        w.cv.wait(lock, [&w](){ return w.filled > 0 || w.eof; });
+        return w.filled > 0;
+    }
+
+    void MultiVideoCapture::pop_head(Worker& w) {
+        std::lock_guard<std::mutex> lock(w.mtx);
+        w.head = (w.head + 1) % queue_size;
+        w.filled--;
+        w.cv.notify_all();
+    }
+
+    double MultiVideoCapture::head_time(Worker& w) {
+        std::lock_guard<std::mutex> lock(w.mtx);
+        return w.slot_pts[w.head];
+    }
+
+    void MultiVideoCapture::release() {
+        for (auto& w : workers) {
+            {
+                std::lock_guard<std::mutex> lock(w->mtx);
+                w->stop = true;
+                w->cv.notify_all();
+            }
+            if (w->thread.joinable()) w->thread.join();
+            w->cap->release();
+        }
+        workers.clear();
+        if (default_buffer) {
+            free(default_buffer);
+            default_buffer = NULL;
+        }
+    }
+
+    void MultiVideoCapture::close() {
+        release();
+    }
+
+    uint8_t* MultiVideoCapture::getBuffer() {
+        if (default_buffer == NULL){
+            default_buffer = (void*)malloc(size_t(bytes_per_frame) * ncams);
+        }
+        return static_cast<uint8_t*>(default_buffer);
+    }
+
+    bool MultiVideoCapture::read(std::vector<void *>& frames) {
+        assert(int(frames.size()) == ncams);
+        if (workers.empty()) return false;
+        if (waitInit) {
+            start();
+            waitInit = false;
+        }
+
+        for (auto& w : workers) {
+            if (!wait_head(*w)) return false;
+        }
+
+        if (align == ALIGN_PTS) {
+            // drop the stale heads until every camera is within half a frame of the newest one
+            const double tolerance = fps > 0 ? 0.5 / fps : 0.5;
+            bool aligned = false;
+            while (!aligned) {
+                double newest = -std::numeric_limits<double>::infinity();
+                for (auto& w : workers) newest = std::max(newest, head_time(*w));
+
+                aligned = true;
+                for (auto& w : workers) {
+                    while (head_time(*w) < newest - tolerance) {
+                        pop_head(*w);
+                        if (!wait_head(*w)) return false;
+                        aligned = false;
+                    }
+                }
+            }
+        }
+
+        for (int i = 0; i < ncams; i++) {
+            Worker& w = *workers[i];
+            memcpy(frames[i], w.slots[w.head].data(), bytes_per_frame);
+            pop_head(w);
+        }
+        iframe += 1;
+        return true;
+    }
+
+    bool MultiVideoCapture::read(void * stacked) {
+        std::vector<void *> frames(ncams);
+        for (int i = 0; i < ncams; i++) {
+            frames[i] = static_cast<uint8_t*>(stacked) + size_t(i) * bytes_per_frame;
+        }
+        return read(frames);
+    }
+
+    std::tuple<bool, std::vector<void *>> MultiVideoCapture::read() {
+        uint8_t* buffer = getBuffer();
+        std::vector<void *> frames(ncams);
+        for (int i = 0; i < ncams; i++) {
+            frames[i] = buffer + size_t(i) * bytes_per_frame;
+        }
+        bool success = read(frames);
+        if (!success) {frames.clear();}
+        return std::make_tuple(success, frames);
+    }
+
+    bool MultiVideoCapture::isOpened() {
+        if (workers.empty()) return false;
+        if (waitInit) return true;
+        for (auto& w : workers) {
+            std::lock_guard<std::mutex> lock(w->mtx);
+            if (w->eof && w->filled == 0) return false;
+        }
+        return true;
+    }
+
+    int MultiVideoCapture::size() {
+        if (!count_exact && !workers.empty()) {
+            count = workers[0]->cap->size();
+            for (auto& w : workers) count = std::min(count, w->cap->size());
+            count_exact = true;
+        }
+        return count;
+    }
+
+    int MultiVideoCapture::len() {
+        return count;
+    }
+
+#ifndef _WIN32
+    static const uint32_t SHM_RING_MAGIC = 0x46464d52;   // "FFMR"
+    static const uint32_t SHM_RING_VERSION = 2;
+
+    inline size_t shm_align64(size_t n) {
+        return (n + 63) & ~size_t(63);
+    }
+
+    inline ShmSlotHeader* shm_slot(const ShmRingHeader* header, uint64_t frame) {
+        char* base = (char*)header + shm_align64(sizeof(ShmRingHeader));
+        return (ShmSlotHeader*)(base + (frame % header->nslots) * header->slot_stride);
+    }
+
+    inline uint8_t* shm_slot_data(ShmSlotHeader* slot) {
+        return (uint8_t*)slot + shm_align64(sizeof(ShmSlotHeader));
+    }
+
+    // a ring whose publisher process is gone; anything else under the name, including a ring that is
+    // still being set up, is left alone
+    inline bool shm_stale(const std::string& name) {
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0) return false;
+        struct stat st;
+        void* addr = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(ShmRingHeader)) {
+            addr = mmap(NULL, sizeof(ShmRingHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if (addr == MAP_FAILED) return false;
+
+        const ShmRingHeader* header = (const ShmRingHeader*)addr;
+        const bool stale = header->magic.load(std::memory_order_acquire) == SHM_RING_MAGIC &&
+                           kill(pid_t(header->publisher_pid), 0) < 0 && errno == ESRCH;
+        munmap(addr, sizeof(ShmRingHeader));
+        return stale;
+    }
+
+    ShmFramePublisher::ShmFramePublisher(){;}
+
+    ShmFramePublisher::ShmFramePublisher(const std::string& name, std::unique_ptr<VideoCapture> cap, int nslots):
+            name(name), cap(std::move(cap)), nslots(std::max(nslots, 2)){
+        assert(this->cap && "No video capture");
+        const int bytes_per_frame = this->cap->bytes_per_frame;
+        const size_t slot_stride = shm_align64(sizeof(ShmSlotHeader)) + shm_align64(bytes_per_frame);
+        map_size = shm_align64(sizeof(ShmRingHeader)) + slot_stride * this->nslots;
+
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0 && errno == EEXIST && shm_stale(name)) {
+            shm_unlink(name.c_str());
+            fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        }
+        if (fd < 0) {
+            const int error = errno;
+            std::cerr << "Failed to create shared memory " << name
+                      << (error == EEXIST ? ": in use by another publisher" : "") << std::endl;
+            errno = error;
+            return;
+        }
+        void* addr = MAP_FAILED;
+        if (ftruncate(fd, off_t(map_size)) == 0) {
+            addr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if (addr == MAP_FAILED) {
+            std::cerr << "Failed to map shared memory " << name << std::endl;
+            shm_unlink(name.c_str());
+            return;
+        }
+
+        // the new object is zero filled, so every slot starts with seq == 0 (never written)
+        header = new (addr) ShmRingHeader();
+        header->version = SHM_RING_VERSION;
+        header->width = this->cap->width;
+        header->height = this->cap->height;
+        header->bytes_per_frame = bytes_per_frame;
+        header->nslots = this->nslots;
+        header->slot_stride = int64_t(slot_stride);
+        header->fps = this->cap->fps;
+        strncpy(header->pix_fmt, this->cap->pix_fmt.c_str(), sizeof(header->pix_fmt) - 1);
+        header->write_seq.store(0);
+        header->closed.store(0);
+        header->publisher_pid = int32_t(getpid());
+        for (int i = 0; i < this->nslots; i++) {
+            new (shm_slot(header, i)) ShmSlotHeader();
+            shm_slot(header, i)->seq.store(0);
+        }
+        // readers only trust the header once the magic is visible
+        header->magic.store(SHM_RING_MAGIC, std::memory_order_release);
+    }
+
+    ShmFramePublisher::~ShmFramePublisher() {
+        release();
+    }
+
+    bool ShmFramePublisher::publish() {
+        if (!header || header->closed.load()) return false;
+
+        const uint64_t frame = uint64_t(iframe + 1);
+        ShmSlotHeader* slot = shm_slot(header, frame);
+        slot->seq.store(2 * frame + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        if (!cap->read(shm_slot_data(slot))) {
+            header->closed.store(1, std::memory_order_release);
+            return false;
+        }
+        slot->seq.store(2 * frame + 2, std::memory_order_release);
+        header->write_seq.store(frame + 1, std::memory_order_release);
+        iframe += 1;
+        return true;
+    }
+
+    int ShmFramePublisher::run() {
+        while (publish()) {;}
+        return iframe + 1;
+    }
+
+    void ShmFramePublisher::release() {
+        if (header) {
+            // attached readers keep their mapping and see the ring as closed
+            header->closed.store(1, std::memory_order_release);
+            munmap((void*)header, map_size);
+            shm_unlink(name.c_str());
+            header = NULL;
+        }
+        if (cap) {
+            cap->release();
+        }
+    }
+
+    void ShmFramePublisher::close() {
+        release();
+    }
+
+    bool ShmFramePublisher::isOpened() {
+        return header != NULL && !header->closed.load();
+    }
+
+    VideoCaptureShm::VideoCaptureShm(){;}
+
+    VideoCaptureShm::VideoCaptureShm(const std::string& name, int timeout_ms): name(name){
+        // the publisher may still be starting up
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        int fd = -1;
+        struct stat st;
+        while (true) {
+            fd = shm_open(name.c_str(), O_RDWR, 0);
+            if (fd >= 0 && fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(ShmRingHeader)) break;
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+            if (std::chrono::steady_clock::now() >= deadline) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        if (fd < 0) {
+            std::cerr << "Failed to open shared memory " << name << std::endl;
+            return;
+        }
+        map_size = size_t(st.st_size);
+        // writable although the reader never writes: a 64-bit atomic load can be a locked cmpxchg8b on
+        // 32-bit x86, which faults on a read-only page
+        void* addr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) {
+            std::cerr << "Failed to map shared memory " << name << std::endl;
+            return;
+        }
+        header = (const ShmRingHeader*)addr;
+        while (header->magic.load(std::memory_order_acquire) != SHM_RING_MAGIC &&
+               std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (header->magic.load(std::memory_order_acquire) != SHM_RING_MAGIC || header->version != SHM_RING_VERSION) {
+            std::cerr << "Not a frame ring: " << name << std::endl;
+            release();
+            return;
+        }
+
+        pix_fmt = std::string(header->pix_fmt, strnlen(header->pix_fmt, sizeof(header->pix_fmt)));
+        width = header->width;
+        height = header->height;
+        fps = header->fps;
+        bytes_per_frame = header->bytes_per_frame;
+        size_wh = Size_wh(width, height);
+        outnumpyshape = get_outnumpyshape(size_wh, pix_fmt);
+
+        // start at the newest frame
+        uint64_t published = header->write_seq.load(std::memory_order_acquire);
+        next = published > 0 ? published - 1 : 0;
+        attached = true;
+    }
+
+    VideoCaptureShm::~VideoCaptureShm() {
+        release();
+    }
+
+    void VideoCaptureShm::release() {
+        if (default_buffer) {
+            free(default_buffer);
+            default_buffer = NULL;
+        }
+        if (header) {
+            munmap((void*)header, map_size);
+            header = NULL;
+        }
+        attached = false;
+    }
+
+    void VideoCaptureShm::close() {
+        release();
+    }
+
+    uint8_t* VideoCaptureShm::getBuffer() {
+        if (default_buffer == NULL){
+            default_buffer = (void*)malloc(bytes_per_frame);
+        }
+        return static_cast<uint8_t*>(default_buffer);
+    }
+
+    bool VideoCaptureShm::read(void * frame) {
+        if (!header) return false;
+
+        int idle = 0;
+        while (true) {
+            const uint64_t published = header->write_seq.load(std::memory_order_acquire);
+            if (next >= published) {
+                // a publisher that crashed never sets closed, so check every 100ms that it still exists
+                bool gone = ++idle % 200 == 0 && kill(pid_t(header->publisher_pid), 0) < 0 && errno == ESRCH;
+                if (gone || header->closed.load(std::memory_order_acquire)) {
+                    release();
+                    return false;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(500));
+                continue;
+            }
+            // lapped: the slot of `next` has been reused, jump to the oldest frame still in the ring
+            const uint64_t oldest = published > uint64_t(header->nslots - 1) ? published - (header->nslots - 1) : 0;
+            if (next < oldest) {
+                dropped_frames += oldest - next;
+                next = oldest;
+            }
+
+            ShmSlotHeader* slot = shm_slot(header, next);
+            const uint64_t seq0 = slot->seq.load(std::memory_order_acquire);
+            if (seq0 == 2 * next + 2) {
+                memcpy(frame, shm_slot_data(slot), bytes_per_frame);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot->seq.load(std::memory_order_relaxed) == seq0) {
+                    iframe = int(next);
+                    next += 1;
+                    return true;
+                }
+            }
+            // torn or already being overwritten: the publisher is ahead, retry from the new position
+            next += 1;
+            dropped_frames += 1;
+        }
+    }
+
+    std::tuple<bool, void *> VideoCaptureShm::read() {
+        uint8_t* buffer = getBuffer();
+        bool success = read(buffer);
+        if (!success) {buffer = NULL;}
+        return std::make_tuple(success, buffer);
+    }
+
+    bool VideoCaptureShm::isOpened() {
+        return attached && header != NULL;
+    }
+#endif
+
     std::string decoder_to_nvidia(const std::string& codec) {
         if (codec == "av1")  return "av1_cuvid";
         if (codec == "h264") return "h264_cuvid";
@@ -1,276 +1,26 @@
 #include <iostream>
 #include <string>
+#include <deque>
 #include "something.h"
 #include "ffmpegcv.hpp"
 #include "filter_graph.h"
+#include "video_capture.h"
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libswscale/swscale.h>
 }
 
-std::tuple<Size_wh, Size_wh, std::string> get_videofilter_cpu(
-        Size_wh originsize, std::string pix_fmt, std::tuple<int, int, int, int> crop_xywh, Size_wh resize) {
-    static const std::vector<std::string> allowed_pix_fmts = {"rgb24", "bgr24", "yuv420p", "yuvj420p", "nv12", "gray"};
-    assert(std::find(allowed_pix_fmts.begin(), allowed_pix_fmts.end(), pix_fmt) != allowed_pix_fmts.end());
-    int origin_width = originsize.width;
-    int origin_height = originsize.height;
-    int crop_x = std::get<0>(crop_xywh);
-    int crop_y = std::get<1>(crop_xywh);
-    int crop_w = std::get<2>(crop_xywh);
-    int crop_h = std::get<3>(crop_xywh);
-    int resize_width = resize.width;
-    int resize_height = resize.height;
-
-    std::string cropopt;
-    if (crop_w != 0 && crop_h != 0) {
-        assert(crop_x % 2 == 0 && crop_y % 2 == 0 && crop_w % 2 == 0 && crop_h % 2 == 0);
-        assert(crop_w <= origin_width && crop_h <= origin_height);
-        cropopt = "crop=" + std::to_string(crop_w) + ":" + std::to_string(crop_h) +
-                  ":" + std::to_string(crop_x) + ":" + std::to_string(crop_y);
-    } else {
-        crop_w = origin_width;
-        crop_h = origin_height;
-        cropopt = "";
-    }
-    Size_wh cropsize = {crop_w, crop_h};
-    Size_wh final_size_wh = cropsize;
-
-    std::string scaleopt="";
-    std::string padopt="";
-    if (!resize.empty() && (resize_width != 0 || resize_height != 0)) {
-        assert (resize_width % 2 == 0 && resize_height % 2 == 0);
-        final_size_wh = resize;
-        scaleopt = "scale=" + std::to_string(resize_width) + "x" + std::to_string(resize_height);
-    }
-
-    std::string pix_fmt_opt = (pix_fmt == "gray") ? "extractplanes=y" : "";
-    std::string filterstr = "";
-    if (!cropopt.empty() || !scaleopt.empty() || !pix_fmt_opt.empty()) {
-        filterstr = "-vf ";
-        if (!cropopt.empty()) filterstr += cropopt + ",";
-        if (!scaleopt.empty()) filterstr += scaleopt + ",";
-        if (!pix_fmt_opt.empty()) filterstr += pix_fmt_opt + ",";
-        filterstr = filterstr.substr(0, filterstr.size() - 1);
-    }
-    return std::make_tuple(cropsize, final_size_wh, filterstr);
-}
-
-std::vector<int> get_outnumpyshape(Size_wh size_wh, std::string pix_fmt) {
-    if (pix_fmt == "bgr24" || pix_fmt == "rgb24") {
-        return {size_wh.height, size_wh.width, 3};
-    } else if (pix_fmt == "gray") {
-        return {size_wh.height, size_wh.width};
-    } else if (pix_fmt == "yuv420p" || pix_fmt == "yuvj420p" || pix_fmt == "nv12") {
-        return {size_wh.height * 3 / 2, size_wh.width};
-    } else {
-        assert(false && "pix_fmt not supported");
-        return {0, 0};
-    }
-}
-
-
-class FFmpegVideoCapture {
-private:
-    AVFormatContext* decoderFmtCtx = nullptr;
-    int videoStreamIndex = -1;
-
-    AVCodecContext* codecContext = nullptr;
-    AVPacket* packet = nullptr;
-    AVFrame* frame = nullptr;
-    AVFilterGraph* filterGraph = nullptr;
-    AVFilterContext* buffersrcCtx = nullptr;
-    AVFilterContext* buffersinkCtx = nullptr;
-
-public:
-    int width = 0;
-    int height = 0;
-    int origin_width = 0;
-    int origin_height = 0;
-    int count = 0;
-    int iframe = -1;
-    double fps = 0;
-    float duration = 0;
-    AVRational fps_r = {60, 1};
-    std::string codecName = "";
-    std::string filename = "";
-    std::string src_pix_fmt = "";
-    std::string tgt_pix_fmt = "";
-    std::tuple<int, int, int, int> crop_xywh = {0, 0, 0, 0};
-    Size_wh size_wh = Size_wh(0, 0);
-    Size_wh resize = Size_wh(0, 0);
-    std::vector<int> outnumpyshape;
-    int bytes_per_frame = 0;
-
-public:
-    // 拷贝视频信息
-    void __copy_videoinfo(VideoInfo &videoInfo){
-        filename = videoInfo.filename;
-        height = origin_height = videoInfo.height;
-        width = origin_width = videoInfo.width;
-        count = videoInfo.count;
-        fps_r = videoInfo.fps_r;
-        fps = videoInfo.fps;
-        duration = videoInfo.duration;
-        codecName = videoInfo.codec;
-        src_pix_fmt = videoInfo.src_pix_fmt;
-        decoderFmtCtx = videoInfo.decoderFmtCtx;
-        videoStreamIndex = videoInfo.videoStreamIndex;
-    }
-
-    FFmpegVideoCapture(const std::string& filename, std::string pix_fmt,
-                       std::tuple<int, int, int, int> crop_xywh = {0, 0, 0, 0},
-                       Size_wh resize = Size_wh(0,0)):
-                       filename(filename), tgt_pix_fmt(pix_fmt), crop_xywh(crop_xywh), resize(resize){
-        // 打开输入文件
-        VideoInfo videoInfo(filename.c_str());
-        videoInfo.show();
-        __copy_videoinfo(videoInfo);
-
-        CHECK (width % 2 == 0, "Height must be even");
-        CHECK ( height % 2 == 0, "Width must be even");
-
-        std::tuple<Size_wh, Size_wh, std::string> filter_options = get_videofilter_cpu(
-                {width, height}, tgt_pix_fmt, crop_xywh, resize);
-        size_wh = std::get<1>(filter_options);
-        std::string filterstr = std::get<2>(filter_options);
-        width = size_wh.width;
-        height = size_wh.height;
-
-        // 创建 avfilter_graph
-        filterstr = "crop=600:400:16:32,scale=400x300";
-        filterGraph = avfilter_graph_alloc();
-
-
-        // 计算每帧的位数
-        outnumpyshape = get_outnumpyshape(size_wh, tgt_pix_fmt);
-        bytes_per_frame = 1;
-        for (int num : outnumpyshape) {bytes_per_frame *= num;}
-
-        // 初始化解码器
-        AVCodecParameters* codecParameters = decoderFmtCtx->streams[videoStreamIndex]->codecpar;
-        const AVCodec* codec = avcodec_find_decoder(codecParameters->codec_id);
-        CHECK (codec,"Unsupported codec!");
-
-        codecContext = avcodec_alloc_context3(codec);
-        CHECK (codecContext,"Failed to allocate codec context.");
-
-        CHECK (avcodec_parameters_to_context(codecContext, codecParameters) >= 0,
-            "Failed to copy codec parameters to context.");
-
-        CHECK (avcodec_open2(codecContext, codec, nullptr) >= 0, "Failed to open codec.");
-
-        packet = av_packet_alloc();
-        frame = av_frame_alloc();
-
-        // 初始化过滤链
-        init_filter_chain(filterstr.c_str());
-    }
-
-    void init_filter_chain(const char* filterstr) {
-        const AVFilter* buffersrc = avfilter_get_by_name("buffer");
-        const AVFilter* buffersink = avfilter_get_by_name("buffersink");
-        AVFilterInOut* inputs = avfilter_inout_alloc();
-        AVFilterInOut* outputs = avfilter_inout_alloc();
-        char args[512];
-
-        // 设置 buffer 源的参数
-        auto video_stream = decoderFmtCtx->streams[videoStreamIndex];
-        snprintf(args, sizeof(args),
-                 "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
-                 codecContext->width, codecContext->height, codecContext->pix_fmt,
-                 video_stream->time_base.num, video_stream->time_base.den,
-                 video_stream->sample_aspect_ratio.num, video_stream->sample_aspect_ratio.den);
-        std::cout << "filter = " << args << std::endl;
-        CHECK(avfilter_graph_create_filter(&buffersrcCtx, buffersrc, "in", args, nullptr, filterGraph) >= 0,
-              "Failed to create buffer source");
-
-        // 设置 buffer 汇的参数
-        CHECK(avfilter_graph_create_filter(&buffersinkCtx, buffersink, "out", nullptr, nullptr, filterGraph) >= 0,
-              "Failed to create buffer sink");
-
-        // 构建过滤链
-        outputs->name = av_strdup("in");
-        outputs->filter_ctx = buffersrcCtx;
-        outputs->pad_idx = 0;
-        outputs->next = nullptr;
-        inputs->name = av_strdup("out");
-        inputs->filter_ctx = buffersinkCtx;
-        inputs->pad_idx = 0;
-        inputs->next = nullptr;
-        CHECK(avfilter_graph_parse_ptr(filterGraph, filterstr, &inputs, &outputs, nullptr) >= 0,
-              "Failed to parse filter graph");
-
-        // 检查 inputs 和 outputs 是否正确设置
-        CHECK(inputs && inputs->filter_ctx, "Failed to find input filter");
-        CHECK(outputs && outputs->filter_ctx, "Failed to find output filter");
-
-        // 链接过滤链
-        CHECK(avfilter_link(buffersrcCtx, 0, inputs->filter_ctx, inputs->pad_idx) >= 0,
-              "Failed to link buffer source");
-
-        CHECK(avfilter_link(outputs->filter_ctx, outputs->pad_idx, buffersinkCtx, 0) >= 0,
-              "Failed to link buffer sink");
-
-        avfilter_inout_free(&inputs);
-        avfilter_inout_free(&outputs);
-
-        // 配置过滤链
-        CHECK(avfilter_graph_config(filterGraph, nullptr) >= 0,
-              "Failed to configure filter graph");
-    }
-
-    // 析构函数：释放资源
-    ~FFmpegVideoCapture() {
-        av_frame_free(&frame);
-        av_packet_free(&packet);
-        avcodec_free_context(&codecContext);
-        avformat_close_input(&decoderFmtCtx);
-        avfilter_graph_free(&filterGraph);
-    }
-
-    // 读取下一帧
-    bool read(AVFrame*& outFrame) {
-        while (true) {
-            int ret = av_read_frame(decoderFmtCtx, packet);
-            if (ret < 0) {
-                // 如果没有更多数据，则发送 NULL 包来触发解码剩余帧
-                avcodec_send_packet(codecContext, nullptr);
-            } else if (packet->stream_index == videoStreamIndex) {
-                // 发送视频流数据包到解码器
-                avcodec_send_packet(codecContext, packet);
-            } else if (packet->stream_index != videoStreamIndex) {
-                continue;
-            }
-
-            av_packet_unref(packet);
-
-            // 接收解码的帧
-            ret = avcodec_receive_frame(codecContext, frame);
-            if (ret == 0) {
-                outFrame = frame;
-                iframe++;
-                return true;
-            } else if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                if (ret == AVERROR_EOF) return false; // 数据读取完成
-                continue;
-            } else {
-                return false;
-            }
-        }
-    }
-
-    bool read(uint8_t*& framebuf){ //allocated frame
-        AVFrame* avframe = nullptr;
-        bool ret = read(avframe);
-        if(!ret){return ret;}
-        framebuf = avframe->data[0];
-        return ret;
-    }
-};
-
+// 异步写视频: write() 只把帧放进有界队列, 编码和封装在单独的线程中完成
 class FFmpegVideoWriter {
 public:
+    using ReleaseFunc = void (*)(void* opaque, uint8_t* data);
+
     std::string filename;
     std::string codec_name;
     float fps;
@@ -278,24 +28,48 @@ public:
     int height;
     Size_wh size_wh;
     std::string pix_fmt;
+    int queue_size = 8;
+    int bytes_per_frame = 0;
 
     AVFormatContext* encoderFmtCtx = nullptr;
     AVCodecContext* codec_ctx = nullptr;
     AVCodec* codec = nullptr;
-    AVFrame* frame = nullptr;
     AVPacket* packet = nullptr;
     int stream_index = 0;
 
+private:
+    AVPixelFormat src_fmt = AV_PIX_FMT_NONE;
+    SwsContext* sws_ctx = nullptr;          // 编码器不支持 pix_fmt 时, 在编码线程中转换
+    AVBufferPool* pool = nullptr;           // 拷贝版 write() 的帧缓冲
+    int64_t next_pts = 0;
+
+    std::deque<AVFrame*> queue;
+    std::mutex mtx;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    bool eof = false;
+    std::string error;
+    std::thread encoder;
+    bool released = false;
+
 public:
-    FFmpegVideoWriter(const std::string& filename, const std::string& codec_name, double fps, Size_wh size_wh, std::string pix_fmt)
+    FFmpegVideoWriter(const std::string& filename, const std::string& codec_name, double fps, Size_wh size_wh,
+                      std::string pix_fmt, int queue_size = 8)
             : filename(filename), codec_name(codec_name), fps(fps), size_wh(size_wh),
-              width(size_wh.width), height(size_wh.height), pix_fmt(pix_fmt) {
+              width(size_wh.width), height(size_wh.height), pix_fmt(pix_fmt), queue_size(std::max(queue_size, 1)) {
+        // 输入帧按 get_outnumpyshape 紧密排列
+        src_fmt = av_get_pix_fmt(pix_fmt.c_str());
+        CHECK(src_fmt != AV_PIX_FMT_NONE, "Unknown pix_fmt");
+        bytes_per_frame = 1;
+        for (int num : get_outnumpyshape(size_wh, pix_fmt)) {bytes_per_frame *= num;}
+
         // 打开输出文件
         CHECK (avformat_alloc_output_context2(&encoderFmtCtx, nullptr, nullptr, filename.c_str()) >= 0,
                 "Could not allocate output context");
 
         // 创建stream
-        CHECK (avformat_new_stream(encoderFmtCtx, nullptr), "Could not create a video stream");
+        AVStream* stream = avformat_new_stream(encoderFmtCtx, nullptr);
+        CHECK (stream, "Could not create a video stream");
 
         // 查找编码器
         codec = const_cast<AVCodec*>(avcodec_find_encoder_by_name(codec_name.c_str())); //"libx264"
@@ -310,19 +84,34 @@ public:
 //        codec_ctx->bit_rate = 400000;
         codec_ctx->width = width;
         codec_ctx->height = height;
-        codec_ctx->time_base = (AVRational){1, int(fps)};
+        codec_ctx->framerate = av_d2q(fps, 100000);
+        codec_ctx->time_base = av_inv_q(codec_ctx->framerate);
 //        codec_ctx->gop_size = 10;
 //        codec_ctx->max_b_frames = 1;
-        codec_ctx->pix_fmt = av_get_pix_fmt("gray"); // 假设输入是灰度图像
+        codec_ctx->pix_fmt = src_fmt;
+        if (codec->pix_fmts) {
+            bool supported = false;
+            for (const AVPixelFormat* p = codec->pix_fmts; *p != AV_PIX_FMT_NONE; p++) {
+                supported |= *p == src_fmt;
+            }
+            if (!supported) {
+                codec_ctx->pix_fmt = avcodec_find_best_pix_fmt_of_list(codec->pix_fmts, src_fmt, 0, nullptr);
+            }
+        }
+        if (encoderFmtCtx->oformat->flags & AVFMT_GLOBALHEADER) {
+            codec_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
 
         // some options
         AVDictionary *encoder_options = nullptr;
         av_dict_set(&encoder_options, "crf", "23", AV_DICT_DONT_OVERWRITE);
         av_dict_set(&encoder_options, "threads", "auto", AV_DICT_DONT_OVERWRITE);
         CHECK (avcodec_open2(codec_ctx, codec, &encoder_options) >= 0, "Can not open the encoder.");
+        av_dict_free(&encoder_options);
 
         // 将编码器参数复制到流中
-        CHECK (avcodec_parameters_from_context(encoderFmtCtx->streams[stream_index]->codecpar, codec_ctx) >= 0,
+        stream->time_base = codec_ctx->time_base;
+        CHECK (avcodec_parameters_from_context(stream->codecpar, codec_ctx) >= 0,
                "Could not copy codec parameters to stream");
 
         // 打开输出文件
@@ -333,67 +122,151 @@ public:
         CHECK (avformat_write_header(encoderFmtCtx, nullptr) >= 0, "Could not write header");
         av_dump_format(encoderFmtCtx, 0, filename.c_str(), 1);
 
-        // 分配 AVFrame
-        frame = av_frame_alloc();
-        frame->format = codec_ctx->pix_fmt;
-        frame->width = width;
-        frame->height = height;
+        if (codec_ctx->pix_fmt != src_fmt) {
+            sws_ctx = sws_getContext(width, height, src_fmt, width, height, codec_ctx->pix_fmt,
+                                     SWS_BICUBIC, nullptr, nullptr, nullptr);
+            CHECK(sws_ctx, "Could not create the pixel format converter");
+        }
+        pool = av_buffer_pool_init(bytes_per_frame, nullptr);
+
+        encoder = std::thread(&FFmpegVideoWriter::encode_loop, this);
+    }
+
+    ~FFmpegVideoWriter() {
+        release();
+    }
 
-        // 分配帧缓冲区
-        CHECK (av_image_alloc(frame->data, frame->linesize, width, height, codec_ctx->pix_fmt, 32) >= 0,
-               "Could not allocate raw picture buffer");
+    // 零拷贝: framearray 直接交给编码线程, 直到 on_release(opaque, framearray) 被调用之前不能修改或释放
+    void write(uint8_t* framearray, ReleaseFunc on_release, void* opaque = nullptr) {
+        AVBufferRef* buf = av_buffer_create(framearray, bytes_per_frame,
+                                            on_release ? on_release : release_nothing, opaque, 0);
+        CHECK(buf, "Could not wrap the frame buffer");
+        push(wrap(buf));
     }
 
+    // 拷贝到缓冲池后立即返回, framearray 可以马上复用
     void write(uint8_t* framearray){
-        // 将输入数据复制到 AVFrame
-        memcpy(frame->data[0], framearray, av_image_get_buffer_size(codec_ctx->pix_fmt, width, height, 32));
-        frame->pts = av_rescale_q(codec_ctx->frame_num, codec_ctx->time_base, encoderFmtCtx->streams[stream_index]->time_base);
-
-        // 编码帧
-        int ret = avcodec_send_frame(codec_ctx, frame);
-        CHECK(ret>=0, "Error sending frame to encoder");
-        while (ret >= 0) {
-            ret = avcodec_receive_packet(codec_ctx, packet);
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {break;}
-            CHECK (ret >=0, "Error during encoding");
+        AVBufferRef* buf = av_buffer_pool_get(pool);
+        CHECK(buf, "Could not allocate a frame buffer");
+        memcpy(buf->data, framearray, bytes_per_frame);
+        push(wrap(buf));
+    }
 
-            // 写入数据包到输出文件
-            packet->stream_index = stream_index;
-            CHECK(av_interleaved_write_frame(encoderFmtCtx, packet) >= 0,
-                  "Error writing packet to output file");
-            av_packet_unref(packet);
+    void release(){
+        if (released) return;
+        released = true;
+
+        // 通知编码线程清空队列和编码器
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            eof = true;
         }
+        not_empty.notify_one();
+        if (encoder.joinable()) encoder.join();
+        for (AVFrame* f : queue) {av_frame_free(&f);}   // 仅在编码出错时残留
+        queue.clear();
+        if (!error.empty()) {std::cerr << "Error: " << error << std::endl;}
+
+        // 写入尾部信息, 之后才能关闭文件
+        av_write_trailer(encoderFmtCtx);
+        if (!(encoderFmtCtx->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&encoderFmtCtx->pb);
+        }
+
+        // 释放资源
+        avcodec_free_context(&codec_ctx);
+        avformat_free_context(encoderFmtCtx);
+        encoderFmtCtx = nullptr;
+        av_packet_free(&packet);
+        sws_freeContext(sws_ctx);
+        sws_ctx = nullptr;
+        av_buffer_pool_uninit(&pool);
     }
 
-    void release(){
-        // 发送 nullptr 帧以触发编码器输出所有缓存的帧
-        int ret = avcodec_send_frame(codec_ctx, nullptr);
-        CHECK (ret >= 0, "Error sending a NULL frame to the encoder");
+private:
+    static void release_nothing(void*, uint8_t*) {}
+
+    AVFrame* wrap(AVBufferRef* buf) {
+        AVFrame* f = av_frame_alloc();
+        f->format = src_fmt;
+        f->width = width;
+        f->height = height;
+        f->buf[0] = buf;
+        av_image_fill_arrays(f->data, f->linesize, buf->data, src_fmt, width, height, 1);
+        return f;
+    }
+
+    void push(AVFrame* f) {
+        if (released) {
+            av_frame_free(&f);
+            CHECK(false, "Writer already released");
+        }
+        std::unique_lock<std::mutex> lock(mtx);
+        not_full.wait(lock, [this]{ return int(queue.size()) < queue_size || !error.empty(); });
+        if (!error.empty()) {
+            av_frame_free(&f);
+            throw std::runtime_error(error);
+        }
+        queue.push_back(f);
+        lock.unlock();
+        not_empty.notify_one();
+    }
+
+    void encode_loop() {
+        try {
+            while (true) {
+                AVFrame* f;
+                {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    not_empty.wait(lock, [this]{ return !queue.empty() || eof; });
+                    if (queue.empty()) break;
+                    f = queue.front();
+                    queue.pop_front();
+                }
+                not_full.notify_one();
+                encode(f);
+            }
+            // 发送 nullptr 帧以触发编码器输出所有缓存的帧
+            encode(nullptr);
+        } catch (const std::exception& e) {
+            std::lock_guard<std::mutex> lock(mtx);
+            error = e.what();
+        }
+        not_full.notify_all();
+    }
 
-        // 接收并写入所有剩余的数据包
+    void encode(AVFrame* f) {
+        if (f && sws_ctx) {
+            AVFrame* converted = av_frame_alloc();
+            converted->format = codec_ctx->pix_fmt;
+            converted->width = width;
+            converted->height = height;
+            int ret = av_frame_get_buffer(converted, 0);
+            if (ret >= 0) {
+                sws_scale(sws_ctx, f->data, f->linesize, 0, height, converted->data, converted->linesize);
+            }
+            av_frame_free(&f);
+            f = converted;
+            if (ret < 0) {av_frame_free(&f);}
+            CHECK(ret >= 0, "Could not allocate the converted frame");
+        }
+        if (f) {f->pts = next_pts++;}
+
+        // 编码帧; 编码器不再引用时, 零拷贝的缓冲通过 on_release 还给调用者
+        int ret = avcodec_send_frame(codec_ctx, f);
+        av_frame_free(&f);
+        CHECK(ret >= 0, "Error sending frame to encoder");
         while (true) {
             ret = avcodec_receive_packet(codec_ctx, packet);
             if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {break;}
-            ; CHECK (ret >=0, "Error during encoding");
-            if (ret < 0) {break;}
+            CHECK (ret >= 0, "Error during encoding");
 
             // 写入数据包到输出文件
             packet->stream_index = stream_index;
-            ret = av_interleaved_write_frame(encoderFmtCtx, packet);
-            if (ret < 0) {break;}
-            av_packet_unref(packet);
-        }
-
-        // 写入尾部信息
-        av_write_trailer(encoderFmtCtx);
-
-        // 释放资源
-        av_frame_free(&frame);
-        avcodec_free_context(&codec_ctx);
-        if (encoderFmtCtx && !(encoderFmtCtx->oformat->flags & AVFMT_NOFILE)) {
-            avio_closep(&encoderFmtCtx->pb);
+            av_packet_rescale_ts(packet, codec_ctx->time_base, encoderFmtCtx->streams[stream_index]->time_base);
+            CHECK(av_interleaved_write_frame(encoderFmtCtx, packet) >= 0,
+                  "Error writing packet to output file");
         }
-        avformat_free_context(encoderFmtCtx);
     }
 };
 
@@ -406,7 +279,7 @@ int main(int argc, char* argv[]) {
                                  "libx264",             // codec
                                  cap.fps,                          // float, frame rate
                                  {cap.width, cap.height},  // frame size
-                                 "gray"                    // source pix_fmt
+                                 cap.tgt_pix_fmt           // source pix_fmt
     );
 
     uint8_t* framearray = nullptr;
@@ -0,0 +1,273 @@
+#include <iostream>
+#include <string>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <csignal>
+#include "something.h"
+#include "video_capture.h"
+#include "frame_server.h"
+
+// 本地帧服务: 常驻进程保持多个文件的 FFmpegVideoCapture, 按 (file, index, count) 随机读取,
+// 帧通过共享内存返回. 解码器和解码出的帧 (seek 后从关键帧到目标帧的整个 GOP) 都按 LRU 缓存
+//
+//   frame_server <socket> [pix_fmt=bgr24] [WxH=0x0] [max_decoders=16] [cache_mb=1024]
+
+// 打开的解码器, 同一文件可以有多个 (并发请求); 优先返回恰好停在 index 之前的那个
+class DecoderPool {
+public:
+    DecoderPool(const std::string& pix_fmt, Size_wh resize, size_t capacity)
+            : pix_fmt(pix_fmt), resize(resize), capacity(capacity) {}
+
+    std::unique_ptr<FFmpegVideoCapture> take(const std::string& filename, int index) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto best = lru.end();
+            for (auto it = lru.begin(); it != lru.end(); ++it) {
+                if (it->first != filename) continue;
+                if (it->second->iframe + 1 == index) {best = it; break;}
+                if (best == lru.end()) best = it;
+            }
+            if (best != lru.end()) {
+                std::unique_ptr<FFmpegVideoCapture> decoder = std::move(best->second);
+                lru.erase(best);
+                return decoder;
+            }
+        }
+        // 在锁外打开文件, 常驻进程不打印每个解码器的信息
+        return std::unique_ptr<FFmpegVideoCapture>(
+                new FFmpegVideoCapture(filename, pix_fmt, {0, 0, 0, 0}, resize, FilterThreading(), false));
+    }
+
+    void put(const std::string& filename, std::unique_ptr<FFmpegVideoCapture> decoder) {
+        std::lock_guard<std::mutex> lock(mtx);
+        lru.emplace_front(filename, std::move(decoder));
+        while (lru.size() > capacity) lru.pop_back();
+    }
+
+private:
+    std::string pix_fmt;
+    Size_wh resize;
+    size_t capacity;
+    std::mutex mtx;
+    std::list<std::pair<std::string, std::unique_ptr<FFmpegVideoCapture>>> lru;
+};
+
+// 已转换好的帧, 按字节数限制的 LRU
+class FrameCache {
+public:
+    explicit FrameCache(size_t budget) : budget(budget) {}
+
+    bool get(const std::string& filename, int index, uint8_t* dst) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = entries.find(Key(filename, index));
+        if (it == entries.end()) return false;
+        lru.splice(lru.begin(), lru, it->second);
+        memcpy(dst, it->second->second.data(), it->second->second.size());
+        return true;
+    }
+
+    void put(const std::string& filename, int index, const uint8_t* src, size_t size) {
+        if (size > budget) return;
+        std::lock_guard<std::mutex> lock(mtx);
+        Key key(filename, index);
+        if (entries.count(key)) return;
+        lru.emplace_front(key, std::vector<uint8_t>(src, src + size));
+        entries[key] = lru.begin();
+        bytes += size;
+        while (bytes > budget) {
+            bytes -= lru.back().second.size();
+            entries.erase(lru.back().first);
+            lru.pop_back();
+        }
+    }
+
+private:
+    using Key = std::pair<std::string, int>;
+    using Entry = std::pair<Key, std::vector<uint8_t>>;
+
+    size_t budget;
+    size_t bytes = 0;
+    std::mutex mtx;
+    std::list<Entry> lru;
+    std::map<Key, std::list<Entry>::iterator> entries;
+};
+
+class FrameServer {
+public:
+    FrameServer(const std::string& pix_fmt, Size_wh resize, size_t max_decoders, size_t cache_bytes)
+            : decoders(pix_fmt, resize, max_decoders), frames(cache_bytes) {}
+
+    // 每个连接一个线程, 一块共享内存; 请求/回复严格交替, 所以客户端读取时服务端不会写入
+    void serve(int fd) {
+        static std::atomic<int> nconn(0);
+        const std::string shm_name = "/ffcv_fs_" + std::to_string(getpid()) + "_" + std::to_string(nconn++);
+        int shm_fd = shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        uint8_t* map = nullptr;
+        size_t map_size = 0;
+
+        frame_server::Request req;
+        while (shm_fd >= 0 && frame_server::read_all(fd, &req, sizeof(req))) {
+            frame_server::Reply reply = {};
+            strncpy(reply.shm_name, shm_name.c_str(), sizeof(reply.shm_name) - 1);
+
+            if (req.magic != frame_server::REQUEST_MAGIC || req.path_len > 4096) break;
+            std::string filename(req.path_len, '\0');
+            if (!frame_server::read_all(fd, &filename[0], req.path_len)) break;
+
+            if (req.index < 0 || req.count <= 0 || req.count > frame_server::MAX_FRAMES_PER_REQUEST) {
+                reply.status = frame_server::STATUS_BAD_REQUEST;
+            } else {
+                try {
+                    handle(filename, req.index, req.count, shm_fd, map, map_size, reply);
+                } catch (const std::exception& e) {
+                    std::cerr << "Error: " << filename << ": " << e.what() << std::endl;
+                    reply.status = frame_server::STATUS_OPEN_FAILED;
+                }
+            }
+            if (!frame_server::write_all(fd, &reply, sizeof(reply))) break;
+        }
+
+        if (map) munmap(map, map_size);
+        if (shm_fd >= 0) {
+            ::close(shm_fd);
+            shm_unlink(shm_name.c_str());
+        }
+        ::close(fd);
+    }
+
+private:
+    void handle(const std::string& filename, int index, int count,
+                int shm_fd, uint8_t*& map, size_t& map_size, frame_server::Reply& reply) {
+        std::unique_ptr<FFmpegVideoCapture> decoder;
+        int bytes_per_frame = 0;
+        int n = 0;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto it = formats.find(filename);
+            if (it != formats.end()) {
+                bytes_per_frame = it->second.bytes_per_frame;
+                reply.width = it->second.width;
+                reply.height = it->second.height;
+            }
+        }
+        auto ensure_map = [&](int bpf) {
+            size_t size = size_t(bpf) * count;
+            if (size <= map_size) return true;
+            if (map) munmap(map, map_size);
+            map = nullptr;
+            map_size = 0;
+            if (ftruncate(shm_fd, off_t(size)) != 0) return false;
+            void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+            if (addr == MAP_FAILED) return false;
+            map = static_cast<uint8_t*>(addr);
+            map_size = size;
+            return true;
+        };
+
+        if (bytes_per_frame && !ensure_map(bytes_per_frame)) {
+            reply.status = frame_server::STATUS_NO_MEMORY;
+            return;
+        }
+
+        while (n < count) {
+            // 帧缓存命中时不需要解码器; 帧大小在第一次打开该文件后才知道
+            if (bytes_per_frame && frames.get(filename, index + n, map + size_t(n) * bytes_per_frame)) {
+                n++;
+                continue;
+            }
+            if (!decoder) {
+                decoder = decoders.take(filename, index + n);
+                bytes_per_frame = decoder->bytes_per_frame;
+                reply.width = decoder->width;
+                reply.height = decoder->height;
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    formats[filename] = {bytes_per_frame, reply.width, reply.height};
+                }
+                if (!ensure_map(bytes_per_frame)) {
+                    reply.status = frame_server::STATUS_NO_MEMORY;
+                    decoders.put(filename, std::move(decoder));
+                    return;
+                }
+                if (frames.get(filename, index + n, map + size_t(n) * bytes_per_frame)) {
+                    n++;
+                    continue;
+                }
+            }
+
+            // 顺序读取时直接往下解码, 否则 seek 到前一个关键帧
+            const int target = index + n;
+            if (decoder->iframe + 1 != target) {
+                const bool forward = target > decoder->iframe && target - decoder->iframe <= std::max(int(decoder->fps), 1);
+                if (!forward && !decoder->seek(target)) break;
+            }
+
+            bool progress = false;
+            uint8_t* buf = nullptr;
+            while (n < count && decoder->read(buf)) {
+                const int k = decoder->iframe;
+                frames.put(filename, k, buf, bytes_per_frame);
+                if (k < index + n) continue;        // 关键帧到目标帧之间: 只进缓存
+                if (k > index + n) break;           // 时间戳有缺口, 返回已有的帧
+                memcpy(map + size_t(n) * bytes_per_frame, buf, bytes_per_frame);
+                n++;
+                progress = true;
+            }
+            if (!progress) break;                   // 文件结尾
+        }
+        if (decoder) decoders.put(filename, std::move(decoder));
+
+        reply.status = n > 0 ? frame_server::STATUS_OK : frame_server::STATUS_NO_FRAMES;
+        reply.count = n;
+        reply.bytes_per_frame = bytes_per_frame;
+        reply.shm_size = map_size;
+    }
+
+    struct FrameFormat {
+        int bytes_per_frame;
+        int width;
+        int height;
+    };
+
+    DecoderPool decoders;
+    FrameCache frames;
+    std::mutex mtx;
+    std::map<std::string, FrameFormat> formats;
+};
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <socket> [pix_fmt=bgr24] [WxH=0x0] [max_decoders=16] [cache_mb=1024]"
+                  << std::endl;
+        return 1;
+    }
+    std::string socket_path = argv[1];
+    std::string pix_fmt = argc > 2 ? argv[2] : "bgr24";
+    Size_wh resize(0, 0);
+    if (argc > 3) sscanf(argv[3], "%dx%d", &resize.width, &resize.height);
+    size_t max_decoders = argc > 4 ? std::stoul(argv[4]) : 16;
+    size_t cache_mb = argc > 5 ? std::stoul(argv[5]) : 1024;
+
+    signal(SIGPIPE, SIG_IGN);
+    av_log_set_level(AV_LOG_ERROR);
+
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path.c_str());
+    CHECK(listen_fd >= 0 && bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) == 0 && listen(listen_fd, 64) == 0,
+          "Failed to listen on the socket");
+
+    FrameServer server(pix_fmt, resize, max_decoders, cache_mb << 20);
+    std::cout << "frame server listening on " << socket_path << std::endl;
+    while (true) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) continue;
+        std::thread(&FrameServer::serve, &server, fd).detach();
+    }
+}
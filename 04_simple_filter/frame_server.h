@@ -0,0 +1,150 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// 本地帧服务的协议: 客户端通过 Unix domain socket 发送 Request + 文件路径,
+// 服务端把解码后的帧写入该连接专用的共享内存, 再回复 Reply
+namespace frame_server {
+    const uint32_t REQUEST_MAGIC = 0x46535251;   // "FSRQ"
+    const int MAX_FRAMES_PER_REQUEST = 1024;
+#ifdef MSG_NOSIGNAL
+    const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    const int SEND_FLAGS = 0;           // macOS: SO_NOSIGPIPE / SIGPIPE ignored by the caller
+#endif
+
+    enum Status {
+        STATUS_OK = 0,
+        STATUS_BAD_REQUEST = -1,
+        STATUS_OPEN_FAILED = -2,
+        STATUS_NO_FRAMES = -3,
+        STATUS_NO_MEMORY = -4,
+    };
+
+    struct Request {
+        uint32_t magic;
+        int32_t index;          // 第一帧的帧号
+        int32_t count;          // 连续帧数
+        uint32_t path_len;      // 后面紧跟 path_len 字节的文件路径
+    };
+
+    struct Reply {
+        int32_t status;
+        int32_t count;          // 实际返回的帧数, 文件结尾时可能少于请求
+        int32_t width;
+        int32_t height;
+        int32_t bytes_per_frame;
+        uint64_t shm_size;
+        char shm_name[64];      // 帧在共享内存中依次排列, 从偏移 0 开始
+    };
+
+    inline bool read_all(int fd, void* buf, size_t n) {
+        char* p = static_cast<char*>(buf);
+        while (n > 0) {
+            ssize_t r = ::read(fd, p, n);
+            if (r <= 0) return false;
+            p += r;
+            n -= r;
+        }
+        return true;
+    }
+
+    inline bool write_all(int fd, const void* buf, size_t n) {
+        const char* p = static_cast<const char*>(buf);
+        while (n > 0) {
+            ssize_t r = ::send(fd, p, n, SEND_FLAGS);
+            if (r <= 0) return false;
+            p += r;
+            n -= r;
+        }
+        return true;
+    }
+
+    // 数据加载进程使用的客户端; 返回的帧指向共享内存, 在下一次 request() 之前有效
+    class FrameClient {
+    public:
+        int width = 0;
+        int height = 0;
+        int bytes_per_frame = 0;
+        int count = 0;
+        int status = STATUS_OK;
+
+        explicit FrameClient(const std::string& socket_path) {
+            sockaddr_un addr = {};
+            addr.sun_family = AF_UNIX;
+            strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+            fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd >= 0 && connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+
+        ~FrameClient() {
+            unmap();
+            if (fd >= 0) ::close(fd);
+        }
+
+        FrameClient(const FrameClient&) = delete;
+        FrameClient& operator=(const FrameClient&) = delete;
+
+        bool isOpened() const { return fd >= 0; }
+
+        bool request(const std::string& filename, int index, int n, const uint8_t*& frames) {
+            frames = nullptr;
+            if (fd < 0) return false;
+
+            Request req = {REQUEST_MAGIC, index, n, uint32_t(filename.size())};
+            Reply reply;
+            if (!write_all(fd, &req, sizeof(req)) || !write_all(fd, filename.data(), filename.size()) ||
+                !read_all(fd, &reply, sizeof(reply))) {
+                ::close(fd);
+                fd = -1;
+                return false;
+            }
+            status = reply.status;
+            if (reply.status != STATUS_OK) return false;
+
+            width = reply.width;
+            height = reply.height;
+            bytes_per_frame = reply.bytes_per_frame;
+            count = reply.count;
+            reply.shm_name[sizeof(reply.shm_name) - 1] = '\0';
+            if (!remap(reply.shm_name, reply.shm_size)) return false;
+            frames = static_cast<const uint8_t*>(map);
+            return true;
+        }
+
+    private:
+        bool remap(const std::string& name, size_t size) {
+            if (map && name == shm_name && size == map_size) return true;
+            unmap();
+            int shm_fd = shm_open(name.c_str(), O_RDONLY, 0);
+            if (shm_fd < 0) return false;
+            void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, shm_fd, 0);
+            ::close(shm_fd);
+            if (addr == MAP_FAILED) return false;
+            map = addr;
+            map_size = size;
+            shm_name = name;
+            return true;
+        }
+
+        void unmap() {
+            if (map) munmap(map, map_size);
+            map = nullptr;
+            map_size = 0;
+        }
+
+        int fd = -1;
+        void* map = nullptr;
+        size_t map_size = 0;
+        std::string shm_name;
+    };
+}
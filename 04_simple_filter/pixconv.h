@@ -0,0 +1,479 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PIXCONV_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PIXCONV_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(PIXCONV_X86) && (defined(__GNUC__) || defined(__clang__))
+#define PIXCONV_TARGET(x) __attribute__((target(x)))
+#else
+#define PIXCONV_TARGET(x)
+#endif
+
+// Hand written YUV 4:2:0 -> packed conversions for the ffmpegcv output formats.
+// The kernel is picked once at runtime (AVX2 > SSE4.1 > C on x86, NEON on ARM);
+// all of them produce exactly the same bytes as the scalar reference yuv_row_c().
+namespace pixconv {
+
+    enum class Format { YUV420P, NV12, GRAY, BGR24, RGB24 };
+
+    inline bool parse_format(const std::string& name, Format& fmt) {
+        if (name == "yuv420p" || name == "yuvj420p") fmt = Format::YUV420P;
+        else if (name == "nv12") fmt = Format::NV12;
+        else if (name == "gray") fmt = Format::GRAY;
+        else if (name == "bgr24") fmt = Format::BGR24;
+        else if (name == "rgb24") fmt = Format::RGB24;
+        else return false;
+        return true;
+    }
+
+    // BT.601 limited range in 6-bit fixed point
+    constexpr int CY  = 75;     // 1.164
+    constexpr int CRV = 102;    // 1.596
+    constexpr int CGU = 25;     // 0.391
+    constexpr int CGV = 52;     // 0.813
+    constexpr int CBU = 129;    // 2.018
+
+    inline uint8_t clamp_u8(int v) { return uint8_t(v < 0 ? 0 : (v > 255 ? 255 : v)); }
+
+    inline void yuv_to_bgr(int y, int u, int v, uint8_t* dst, bool rgb) {
+        const int yy = (y - 16) * CY;
+        u -= 128;
+        v -= 128;
+        const uint8_t b = clamp_u8((yy + CBU * u + 32) >> 6);
+        const uint8_t g = clamp_u8((yy - CGU * u - CGV * v + 32) >> 6);
+        const uint8_t r = clamp_u8((yy + CRV * v + 32) >> 6);
+        dst[0] = rgb ? r : b;
+        dst[1] = g;
+        dst[2] = rgb ? b : r;
+    }
+
+    // one output row; `u`/`v` hold width/2 chroma samples, `uv_step` is 1 for planar and 2 for NV12
+    using RowFunc = void (*)(const uint8_t* y, const uint8_t* u, const uint8_t* v, int uv_step,
+                             uint8_t* dst, int width, bool rgb);
+
+    inline void yuv_row_c(const uint8_t* y, const uint8_t* u, const uint8_t* v, int uv_step,
+                          uint8_t* dst, int width, bool rgb) {
+        for (int x = 0; x < width; x++) {
+            const int c = (x >> 1) * uv_step;
+            yuv_to_bgr(y[x], u[c], v[c], dst + x * 3, rgb);
+        }
+    }
+
+#ifdef PIXCONV_X86
+    // pshufb masks interleaving 16 B, 16 G and 16 R bytes into 48 bytes of BGR
+    struct InterleaveMasks {
+        alignas(16) uint8_t m[3][3][16];    // [output vector][channel][byte]
+
+        InterleaveMasks() {
+            for (int o = 0; o < 3; o++)
+                for (int c = 0; c < 3; c++)
+                    for (int k = 0; k < 16; k++) {
+                        const int pos = o * 16 + k;
+                        m[o][c][k] = (pos % 3 == c) ? uint8_t(pos / 3) : 0x80;
+                    }
+        }
+
+        static const InterleaveMasks& get() {
+            static const InterleaveMasks masks;
+            return masks;
+        }
+    };
+
+    PIXCONV_TARGET("sse4.1")
+    inline void store_bgr48(uint8_t* dst, __m128i b, __m128i g, __m128i r, const InterleaveMasks& im) {
+        for (int o = 0; o < 3; o++) {
+            const __m128i out = _mm_or_si128(
+                    _mm_or_si128(_mm_shuffle_epi8(b, _mm_load_si128((const __m128i*)im.m[o][0])),
+                                 _mm_shuffle_epi8(g, _mm_load_si128((const __m128i*)im.m[o][1]))),
+                    _mm_shuffle_epi8(r, _mm_load_si128((const __m128i*)im.m[o][2])));
+            _mm_storeu_si128((__m128i*)(dst + o * 16), out);
+        }
+    }
+
+    // 8 pixels: y, u, v are 16-bit lanes, u/v already centered; returns 16-bit b, g, r
+    PIXCONV_TARGET("sse4.1")
+    inline void yuv8_sse41(__m128i y, __m128i u, __m128i v, __m128i& b, __m128i& g, __m128i& r) {
+        const __m128i round = _mm_set1_epi16(32);
+        const __m128i yy = _mm_mullo_epi16(_mm_sub_epi16(y, _mm_set1_epi16(16)), _mm_set1_epi16(CY));
+        b = _mm_srai_epi16(_mm_adds_epi16(_mm_adds_epi16(yy, _mm_mullo_epi16(u, _mm_set1_epi16(CBU))), round), 6);
+        g = _mm_srai_epi16(_mm_adds_epi16(_mm_adds_epi16(_mm_adds_epi16(yy,
+                                                                        _mm_mullo_epi16(u, _mm_set1_epi16(-CGU))),
+                                                         _mm_mullo_epi16(v, _mm_set1_epi16(-CGV))), round), 6);
+        r = _mm_srai_epi16(_mm_adds_epi16(_mm_adds_epi16(yy, _mm_mullo_epi16(v, _mm_set1_epi16(CRV))), round), 6);
+    }
+
+    PIXCONV_TARGET("sse4.1")
+    inline void yuv_row_sse41(const uint8_t* y, const uint8_t* u, const uint8_t* v, int uv_step,
+                              uint8_t* dst, int width, bool rgb) {
+        const InterleaveMasks& im = InterleaveMasks::get();
+        const __m128i bias = _mm_set1_epi16(128);
+        int x = 0;
+        for (; x + 16 <= width; x += 16) {
+            const __m128i y8 = _mm_loadu_si128((const __m128i*)(y + x));
+            __m128i u16, v16;
+            if (uv_step == 2) {
+                const __m128i uv = _mm_loadu_si128((const __m128i*)(u + x));
+                u16 = _mm_and_si128(uv, _mm_set1_epi16(0x00ff));
+                v16 = _mm_srli_epi16(uv, 8);
+            }
+            else {
+                u16 = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(u + x / 2)));
+                v16 = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(v + x / 2)));
+            }
+            u16 = _mm_sub_epi16(u16, bias);
+            v16 = _mm_sub_epi16(v16, bias);
+
+            __m128i b0, g0, r0, b1, g1, r1;
+            yuv8_sse41(_mm_cvtepu8_epi16(y8), _mm_unpacklo_epi16(u16, u16), _mm_unpacklo_epi16(v16, v16), b0, g0, r0);
+            yuv8_sse41(_mm_unpackhi_epi8(y8, _mm_setzero_si128()),
+                       _mm_unpackhi_epi16(u16, u16), _mm_unpackhi_epi16(v16, v16), b1, g1, r1);
+
+            const __m128i b = _mm_packus_epi16(b0, b1);
+            const __m128i g = _mm_packus_epi16(g0, g1);
+            const __m128i r = _mm_packus_epi16(r0, r1);
+            store_bgr48(dst + x * 3, rgb ? r : b, g, rgb ? b : r, im);
+        }
+        yuv_row_c(y + x, u + (x / 2) * uv_step, v + (x / 2) * uv_step, uv_step, dst + x * 3, width - x, rgb);
+    }
+
+    PIXCONV_TARGET("avx2")
+    inline void yuv16_avx2(__m256i y, __m256i u, __m256i v, __m256i& b, __m256i& g, __m256i& r) {
+        const __m256i round = _mm256_set1_epi16(32);
+        const __m256i yy = _mm256_mullo_epi16(_mm256_sub_epi16(y, _mm256_set1_epi16(16)), _mm256_set1_epi16(CY));
+        b = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_adds_epi16(yy, _mm256_mullo_epi16(u, _mm256_set1_epi16(CBU))),
+                                                round), 6);
+        g = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_adds_epi16(_mm256_adds_epi16(yy,
+                                                                                    _mm256_mullo_epi16(u, _mm256_set1_epi16(-CGU))),
+                                                                  _mm256_mullo_epi16(v, _mm256_set1_epi16(-CGV))),
+                                                round), 6);
+        r = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_adds_epi16(yy, _mm256_mullo_epi16(v, _mm256_set1_epi16(CRV))),
+                                                round), 6);
+    }
+
+    PIXCONV_TARGET("avx2")
+    inline void yuv_row_avx2(const uint8_t* y, const uint8_t* u, const uint8_t* v, int uv_step,
+                             uint8_t* dst, int width, bool rgb) {
+        const InterleaveMasks& im = InterleaveMasks::get();
+        const __m256i bias = _mm256_set1_epi16(128);
+        int x = 0;
+        for (; x + 32 <= width; x += 32) {
+            const __m256i y8 = _mm256_loadu_si256((const __m256i*)(y + x));
+            __m256i u16, v16;   // 16 chroma samples in order
+            if (uv_step == 2) {
+                const __m256i uv = _mm256_loadu_si256((const __m256i*)(u + x));
+                u16 = _mm256_and_si256(uv, _mm256_set1_epi16(0x00ff));
+                v16 = _mm256_srli_epi16(uv, 8);
+            }
+            else {
+                u16 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(u + x / 2)));
+                v16 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(v + x / 2)));
+            }
+            // the 16-bit unpacks work per 128-bit lane: reorder the quadwords to [0, 2, 1, 3] first
+            u16 = _mm256_permute4x64_epi64(_mm256_sub_epi16(u16, bias), 0xd8);
+            v16 = _mm256_permute4x64_epi64(_mm256_sub_epi16(v16, bias), 0xd8);
+
+            __m256i b0, g0, r0, b1, g1, r1;
+            yuv16_avx2(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(y8)),
+                       _mm256_unpacklo_epi16(u16, u16), _mm256_unpacklo_epi16(v16, v16), b0, g0, r0);
+            yuv16_avx2(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(y8, 1)),
+                       _mm256_unpackhi_epi16(u16, u16), _mm256_unpackhi_epi16(v16, v16), b1, g1, r1);
+
+            const __m256i b = _mm256_permute4x64_epi64(_mm256_packus_epi16(b0, b1), 0xd8);
+            const __m256i g = _mm256_permute4x64_epi64(_mm256_packus_epi16(g0, g1), 0xd8);
+            const __m256i r = _mm256_permute4x64_epi64(_mm256_packus_epi16(r0, r1), 0xd8);
+            const __m256i& c0 = rgb ? r : b;
+            const __m256i& c2 = rgb ? b : r;
+            store_bgr48(dst + x * 3, _mm256_castsi256_si128(c0), _mm256_castsi256_si128(g),
+                        _mm256_castsi256_si128(c2), im);
+            store_bgr48(dst + x * 3 + 48, _mm256_extracti128_si256(c0, 1), _mm256_extracti128_si256(g, 1),
+                        _mm256_extracti128_si256(c2, 1), im);
+        }
+        yuv_row_sse41(y + x, u + (x / 2) * uv_step, v + (x / 2) * uv_step, uv_step, dst + x * 3, width - x, rgb);
+    }
+
+    inline bool cpu_has(bool avx2) {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        const bool sse41 = info[2] & (1 << 19);
+        const bool osxsave_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28));
+        if (!avx2) return sse41;
+        if (!osxsave_avx || (_xgetbv(0) & 0x6) != 0x6) return false;
+        __cpuidex(info, 7, 0);
+        return info[1] & (1 << 5);
+#else
+        return avx2 ? __builtin_cpu_supports("avx2") : __builtin_cpu_supports("sse4.1");
+#endif
+    }
+#endif // PIXCONV_X86
+
+#ifdef PIXCONV_NEON
+    inline void yuv8_neon(int16x8_t y, int16x8_t u, int16x8_t v, int16x8_t& b, int16x8_t& g, int16x8_t& r) {
+        const int16x8_t round = vdupq_n_s16(32);
+        const int16x8_t yy = vmulq_n_s16(vsubq_s16(y, vdupq_n_s16(16)), CY);
+        b = vshrq_n_s16(vqaddq_s16(vqaddq_s16(yy, vmulq_n_s16(u, CBU)), round), 6);
+        g = vshrq_n_s16(vqaddq_s16(vqaddq_s16(vqaddq_s16(yy, vmulq_n_s16(u, -CGU)), vmulq_n_s16(v, -CGV)), round), 6);
+        r = vshrq_n_s16(vqaddq_s16(vqaddq_s16(yy, vmulq_n_s16(v, CRV)), round), 6);
+    }
+
+    inline void yuv_row_neon(const uint8_t* y, const uint8_t* u, const uint8_t* v, int uv_step,
+                             uint8_t* dst, int width, bool rgb) {
+        const int16x8_t bias = vdupq_n_s16(128);
+        int x = 0;
+        for (; x + 16 <= width; x += 16) {
+            const uint8x16_t y8 = vld1q_u8(y + x);
+            uint8x8_t u8, v8;
+            if (uv_step == 2) {
+                const uint8x8x2_t uv = vld2_u8(u + x);
+                u8 = uv.val[0];
+                v8 = uv.val[1];
+            }
+            else {
+                u8 = vld1_u8(u + x / 2);
+                v8 = vld1_u8(v + x / 2);
+            }
+            const int16x8_t u16 = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), bias);
+            const int16x8_t v16 = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), bias);
+            const int16x8x2_t uu = vzipq_s16(u16, u16);
+            const int16x8x2_t vv = vzipq_s16(v16, v16);
+
+            int16x8_t b0, g0, r0, b1, g1, r1;
+            yuv8_neon(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(y8))), uu.val[0], vv.val[0], b0, g0, r0);
+            yuv8_neon(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(y8))), uu.val[1], vv.val[1], b1, g1, r1);
+
+            const uint8x16_t b = vcombine_u8(vqmovun_s16(b0), vqmovun_s16(b1));
+            const uint8x16_t g = vcombine_u8(vqmovun_s16(g0), vqmovun_s16(g1));
+            const uint8x16_t r = vcombine_u8(vqmovun_s16(r0), vqmovun_s16(r1));
+            uint8x16x3_t bgr;
+            bgr.val[0] = rgb ? r : b;
+            bgr.val[1] = g;
+            bgr.val[2] = rgb ? b : r;
+            vst3q_u8(dst + x * 3, bgr);
+        }
+        yuv_row_c(y + x, u + (x / 2) * uv_step, v + (x / 2) * uv_step, uv_step, dst + x * 3, width - x, rgb);
+    }
+#endif // PIXCONV_NEON
+
+    inline RowFunc yuv_row() {
+        static const RowFunc func = []() -> RowFunc {
+#if defined(PIXCONV_X86)
+            if (cpu_has(true)) return yuv_row_avx2;
+            if (cpu_has(false)) return yuv_row_sse41;
+#elif defined(PIXCONV_NEON)
+            return yuv_row_neon;
+#endif
+            return yuv_row_c;
+        }();
+        return func;
+    }
+
+    // Converts the w x h window at (x, y) of a YUV 4:2:0 frame into `dst`, packed with the
+    // layout of get_outnumpyshape(). x, y, w, h must be even. Returns false for unsupported pairs.
+    inline bool convert(const uint8_t* const src[], const int src_linesize[], Format src_fmt,
+                        int x, int y, int w, int h, uint8_t* dst, Format dst_fmt) {
+        if (src_fmt != Format::YUV420P && src_fmt != Format::NV12) return false;
+        if ((x | y | w | h) & 1) return false;
+
+        const bool nv12 = src_fmt == Format::NV12;
+        const int uv_step = nv12 ? 2 : 1;
+        const uint8_t* sy = src[0] + y * src_linesize[0] + x;
+        const uint8_t* su = src[1] + (y / 2) * src_linesize[1] + (x / 2) * uv_step;
+        const uint8_t* sv = nv12 ? su + 1 : src[2] + (y / 2) * src_linesize[2] + x / 2;
+        const int su_stride = src_linesize[1];
+        const int sv_stride = nv12 ? src_linesize[1] : src_linesize[2];
+
+        switch (dst_fmt) {
+        case Format::BGR24:
+        case Format::RGB24: {
+            const RowFunc row = yuv_row();
+            const bool rgb = dst_fmt == Format::RGB24;
+            for (int j = 0; j < h; j++) {
+                row(sy + j * src_linesize[0], su + (j / 2) * su_stride, sv + (j / 2) * sv_stride, uv_step,
+                    dst + size_t(j) * w * 3, w, rgb);
+            }
+            return true;
+        }
+        case Format::GRAY:
+            for (int j = 0; j < h; j++) {
+                std::memcpy(dst + size_t(j) * w, sy + j * src_linesize[0], w);
+            }
+            return true;
+        case Format::YUV420P:
+        case Format::NV12: {
+            for (int j = 0; j < h; j++) {
+                std::memcpy(dst + size_t(j) * w, sy + j * src_linesize[0], w);
+            }
+            uint8_t* du = dst + size_t(w) * h;
+            uint8_t* dv = du + size_t(w / 2) * (h / 2);
+            for (int j = 0; j < h / 2; j++) {
+                const uint8_t* ur = su + j * su_stride;
+                const uint8_t* vr = sv + j * sv_stride;
+                if (dst_fmt == src_fmt) {
+                    std::memcpy(nv12 ? du + size_t(j) * w : du + size_t(j) * (w / 2), ur, nv12 ? w : w / 2);
+                    if (!nv12) std::memcpy(dv + size_t(j) * (w / 2), vr, w / 2);
+                }
+                else if (dst_fmt == Format::NV12) {
+                    uint8_t* uv = du + size_t(j) * w;
+                    for (int i = 0; i < w / 2; i++) {
+                        uv[2 * i] = ur[i];
+                        uv[2 * i + 1] = vr[i];
+                    }
+                }
+                else {
+                    for (int i = 0; i < w / 2; i++) {
+                        du[size_t(j) * (w / 2) + i] = ur[2 * i];
+                        dv[size_t(j) * (w / 2) + i] = vr[2 * i];
+                    }
+                }
+            }
+            return true;
+        }
+        }
+        return false;
+    }
+
+    // Crop + resize + convert in a single pass: only the source rows that contribute to the output
+    // are read, and each output row goes through one Y and one U/V scratch row (a few KB, stays in
+    // L1) before being converted straight into `dst`. The filter is the one of swscale's bilinear
+    // (scale=...:flags=bilinear, the filter graph fallback): a triangle that is one source pixel
+    // wide when upscaling and widens with the ratio when downscaling, so large downscales average
+    // instead of aliasing.
+    class CropResize {
+    public:
+        CropResize() = default;
+
+        CropResize(int x, int y, int crop_w, int crop_h, int out_w, int out_h)
+                : x_(x), y_(y), out_w_(out_w), out_h_(out_h),
+                  lx_(taps(crop_w, out_w)), ly_(taps(crop_h, out_h)),
+                  cx_(taps(crop_w / 2, out_w / 2)), cy_(taps(crop_h / 2, out_h / 2)),
+                  acc_(crop_w), yrow_(out_w), urow_(out_w / 2), vrow_(out_w / 2) {}
+
+        bool empty() const { return out_w_ == 0 || out_h_ == 0; }
+
+        bool run(const uint8_t* const src[], const int src_linesize[], Format src_fmt, uint8_t* dst, Format dst_fmt) {
+            if (empty() || (src_fmt != Format::YUV420P && src_fmt != Format::NV12)) return false;
+            if ((x_ | y_ | out_w_ | out_h_) & 1) return false;
+
+            const bool nv12 = src_fmt == Format::NV12;
+            const int uv_step = nv12 ? 2 : 1;
+            const uint8_t* sy = src[0] + y_ * src_linesize[0] + x_;
+            const uint8_t* su = src[1] + (y_ / 2) * src_linesize[1] + (x_ / 2) * uv_step;
+            const uint8_t* sv = nv12 ? su + 1 : src[2] + (y_ / 2) * src_linesize[2] + x_ / 2;
+            const int su_stride = src_linesize[1];
+            const int sv_stride = nv12 ? src_linesize[1] : src_linesize[2];
+
+            const bool packed = dst_fmt == Format::BGR24 || dst_fmt == Format::RGB24;
+            const bool chroma = dst_fmt != Format::GRAY;
+            const RowFunc row = yuv_row();
+            uint8_t* du = dst + size_t(out_w_) * out_h_;
+            uint8_t* dv = du + size_t(out_w_ / 2) * (out_h_ / 2);
+
+            for (int j = 0; j < out_h_; j++) {
+                uint8_t* yout = packed ? yrow_.data() : dst + size_t(j) * out_w_;
+                filter_row(sy, src_linesize[0], 1, ly_, j, lx_, yout);
+
+                // one chroma row serves two output rows
+                if (chroma && (j & 1) == 0) {
+                    const int c = j / 2;
+                    filter_row(su, su_stride, uv_step, cy_, c, cx_, urow_.data());
+                    filter_row(sv, sv_stride, uv_step, cy_, c, cx_, vrow_.data());
+
+                    if (dst_fmt == Format::YUV420P) {
+                        std::memcpy(du + size_t(c) * (out_w_ / 2), urow_.data(), out_w_ / 2);
+                        std::memcpy(dv + size_t(c) * (out_w_ / 2), vrow_.data(), out_w_ / 2);
+                    }
+                    else if (dst_fmt == Format::NV12) {
+                        uint8_t* uv = du + size_t(c) * out_w_;
+                        for (int i = 0; i < out_w_ / 2; i++) {
+                            uv[2 * i] = urow_[i];
+                            uv[2 * i + 1] = vrow_[i];
+                        }
+                    }
+                }
+
+                if (packed) {
+                    row(yrow_.data(), urow_.data(), vrow_.data(), 1, dst + size_t(j) * out_w_ * 3, out_w_,
+                        dst_fmt == Format::RGB24);
+                }
+            }
+            return true;
+        }
+
+        // the weights of output pixel i along one axis, exposed for the reference check of pixconv_bench
+        struct Taps {
+            std::vector<int> begin;             // taps of output i: [begin[i], begin[i + 1])
+            std::vector<int> index, weight;     // source index (edges replicated), weight / 4096
+            int src_size = 0;
+        };
+
+        // pixel centers aligned like swscale, the weights of each output pixel sum to exactly 4096
+        static Taps taps(int src_size, int dst_size) {
+            Taps t;
+            t.src_size = src_size;
+            const double scale = double(src_size) / std::max(dst_size, 1);
+            const double support = std::max(scale, 1.0);
+            for (int i = 0; i < dst_size; i++) {
+                t.begin.push_back(int(t.index.size()));
+                const double center = (i + 0.5) * scale - 0.5;
+                int sum = 0, largest = int(t.index.size());
+                for (int k = int(std::ceil(center - support)); k <= int(std::floor(center + support)); k++) {
+                    const int w = int((1 - std::fabs(k - center) / support) * 4096 + 0.5);
+                    if (w <= 0) continue;
+                    if (t.weight.size() > size_t(largest) && w > t.weight[largest]) largest = int(t.index.size());
+                    t.index.push_back(std::min(std::max(k, 0), src_size - 1));
+                    t.weight.push_back(w);
+                    sum += w;
+                }
+                const double norm = 4096.0 / sum;
+                sum = 0;
+                for (size_t k = t.begin.back(); k < t.weight.size(); k++) {
+                    t.weight[k] = int(t.weight[k] * norm + 0.5);
+                    sum += t.weight[k];
+                }
+                t.weight[largest] += 4096 - sum;
+            }
+            t.begin.push_back(int(t.index.size()));
+            return t;
+        }
+
+    private:
+        // vertical taps of output row j into acc_ (8 fractional bits), then the horizontal ones
+        void filter_row(const uint8_t* plane, int stride, int step, const Taps& ty, int j, const Taps& tx,
+                        uint8_t* out) {
+            const int n = int(tx.begin.size()) - 1;
+            const int src_w = tx.src_size;
+            std::fill(acc_.begin(), acc_.begin() + src_w, 0);
+            for (int k = ty.begin[j]; k < ty.begin[j + 1]; k++) {
+                const uint8_t* row = plane + size_t(ty.index[k]) * stride;
+                const int w = ty.weight[k];
+                for (int x = 0; x < src_w; x++) acc_[x] += row[x * step] * w;
+            }
+            for (int x = 0; x < src_w; x++) acc_[x] = (acc_[x] + (1 << 3)) >> 4;
+
+            for (int i = 0; i < n; i++) {
+                int sum = 0;
+                for (int k = tx.begin[i]; k < tx.begin[i + 1]; k++) sum += acc_[tx.index[k]] * tx.weight[k];
+                out[i] = uint8_t((sum + (1 << 19)) >> 20);
+            }
+        }
+
+        int x_ = 0, y_ = 0, out_w_ = 0, out_h_ = 0;
+        Taps lx_, ly_, cx_, cy_;
+        std::vector<int> acc_;
+        std::vector<uint8_t> yrow_, urow_, vrow_;
+    };
+} // namespace pixconv
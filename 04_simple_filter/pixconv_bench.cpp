@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include "pixconv.h"
+
+// pixconv 的逐位对比和性能测试: 每个 SIMD 行函数 (SSE4.1/AVX2/NEON, 只测 CPU 支持的) 在奇数宽高,
+// 非对齐地址和极值数据上与标量 yuv_row_c() 的输出逐字节比较; CropResize 与双精度的 swscale bilinear
+// 参考实现比较; 然后计时整帧转换
+//
+//   pixconv_bench [WxH=1920x1080] [iterations=200]
+
+struct Kernel {
+    const char* name;
+    pixconv::RowFunc row;
+};
+
+static std::vector<Kernel> kernels() {
+    std::vector<Kernel> list = {{"c", pixconv::yuv_row_c}};
+#if defined(PIXCONV_X86)
+    if (pixconv::cpu_has(false)) list.push_back({"sse4.1", pixconv::yuv_row_sse41});
+    if (pixconv::cpu_has(true)) list.push_back({"avx2", pixconv::yuv_row_avx2});
+#elif defined(PIXCONV_NEON)
+    list.push_back({"neon", pixconv::yuv_row_neon});
+#endif
+    return list;
+}
+
+// w x h 的 yuv420p 或 nv12 帧, 奇数宽高时色度向上取整; 每个平面都从奇地址开始
+struct Frame {
+    int w, h, cw, ch;
+    bool nv12;
+    std::vector<uint8_t> y, u, v;
+
+    Frame(int w, int h, bool nv12)
+            : w(w), h(h), cw((w + 1) / 2), ch((h + 1) / 2), nv12(nv12),
+              y(size_t(w) * h + 1), u(size_t(cw) * ch * (nv12 ? 2 : 1) + 1), v(size_t(cw) * ch + 1) {}
+
+    uint8_t* py() { return y.data() + 1; }
+    uint8_t* pu() { return u.data() + 1; }
+    uint8_t* pv() { return nv12 ? u.data() + 2 : v.data() + 1; }
+    int uv_stride() const { return nv12 ? cw * 2 : cw; }
+    int uv_step() const { return nv12 ? 2 : 1; }
+
+    void fill(std::mt19937& rng, int mode) {
+        auto gen = [&rng, mode]() -> uint8_t {
+            if (mode == 1) return 0;
+            if (mode == 2) return 255;
+            if (mode == 3) return (rng() & 1) ? 255 : 0;
+            return uint8_t(rng());
+        };
+        for (auto& b : y) b = gen();
+        for (auto& b : u) b = gen();
+        for (auto& b : v) b = gen();
+    }
+};
+
+static void convert(Frame& f, pixconv::RowFunc row, uint8_t* dst, bool rgb) {
+    for (int j = 0; j < f.h; j++) {
+        const int c = (j / 2) * f.uv_stride();
+        row(f.py() + size_t(j) * f.w, f.pu() + c, f.pv() + c, f.uv_step(), dst + size_t(j) * f.w * 3, f.w, rgb);
+    }
+}
+
+static int check(const std::vector<Kernel>& list) {
+    static const int widths[] = {1, 2, 3, 7, 15, 16, 17, 31, 32, 33, 47, 48, 63, 64, 65, 95, 127, 641, 1921};
+    static const int heights[] = {1, 2, 3, 17};
+    static const char* modes[] = {"random", "zero", "full", "extreme"};
+
+    std::mt19937 rng(20241019);
+    int failures = 0, cases = 0;
+    for (int w : widths) {
+        for (int h : heights) {
+            for (int nv12 = 0; nv12 < 2; nv12++) {
+                for (int mode = 0; mode < 4; mode++) {
+                    Frame f(w, h, nv12 != 0);
+                    f.fill(rng, mode);
+                    for (int rgb = 0; rgb < 2; rgb++) {
+                        // 输出缓冲区同样从奇地址开始, 末尾的哨兵字节用来发现越界写
+                        const size_t size = size_t(w) * h * 3;
+                        std::vector<uint8_t> ref(size + 2, 0xa5);
+                        convert(f, pixconv::yuv_row_c, ref.data() + 1, rgb != 0);
+                        for (size_t k = 1; k < list.size(); k++) {
+                            std::vector<uint8_t> out(size + 2, 0xa5);
+                            convert(f, list[k].row, out.data() + 1, rgb != 0);
+                            cases++;
+                            if (out == ref) continue;
+
+                            size_t at = 0;
+                            while (at < out.size() && out[at] == ref[at]) at++;
+                            std::printf("MISMATCH %-6s %s %s %4dx%-2d %-7s: byte %zu (pixel %zu) %d != %d\n",
+                                        list[k].name, nv12 ? "nv12   " : "yuv420p", rgb ? "rgb24" : "bgr24", w, h,
+                                        modes[mode], at - 1, (at - 1) / 3, out[at], ref[at]);
+                            failures++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    std::printf("bit-exact: %d/%d cases match the scalar reference\n", cases - failures, cases);
+    return failures;
+}
+
+// swscale 的 bilinear (scale=...:flags=bilinear) 按定义用 double 计算: 三角形滤波器, 缩小时按比例加宽
+static std::vector<uint8_t> resize_ref(const uint8_t* src, int stride, int step, int src_w, int src_h, int dst_w, int dst_h) {
+    auto weights = [](int src_size, int dst_size, int i, std::vector<std::pair<int, double>>& taps) {
+        const double scale = double(src_size) / dst_size, support = std::max(scale, 1.0);
+        const double center = (i + 0.5) * scale - 0.5;
+        double sum = 0;
+        taps.clear();
+        for (int k = int(std::ceil(center - support)); k <= int(std::floor(center + support)); k++) {
+            const double w = 1 - std::fabs(k - center) / support;
+            if (w <= 0) continue;
+            taps.push_back({std::min(std::max(k, 0), src_size - 1), w});
+            sum += w;
+        }
+        for (auto& t : taps) t.second /= sum;
+    };
+
+    std::vector<uint8_t> out(size_t(dst_w) * dst_h);
+    std::vector<std::pair<int, double>> tx, ty;
+    for (int j = 0; j < dst_h; j++) {
+        weights(src_h, dst_h, j, ty);
+        for (int i = 0; i < dst_w; i++) {
+            weights(src_w, dst_w, i, tx);
+            double v = 0;
+            for (const auto& y : ty) {
+                for (const auto& x : tx) v += src[size_t(y.first) * stride + size_t(x.first) * step] * y.second * x.second;
+            }
+            out[size_t(j) * dst_w + i] = uint8_t(std::min(std::max(std::lround(v), 0L), 255L));
+        }
+    }
+    return out;
+}
+
+// 缩小 1x..8x 和放大, 随机数据和 1 像素宽的黑白竖条 (双线性不加宽时缩小后仍是黑白条纹, 加宽后是均匀的灰)
+static int check_resize() {
+    struct Case { int cw, ch, ow, oh; };
+    static const Case cases[] = {{64, 48, 96, 72}, {64, 48, 64, 48}, {128, 96, 64, 48}, {192, 144, 64, 48},
+                                 {1920, 1080, 640, 360}, {1920, 1080, 426, 240}, {1280, 720, 160, 92}};
+    static const char* modes[] = {"random", "stripes"};
+
+    std::mt19937 rng(20241020);
+    int failures = 0, total = 0;
+    for (const Case& c : cases) {
+        for (int nv12 = 0; nv12 < 2; nv12++) {
+            for (int mode = 0; mode < 2; mode++) {
+                // 裁剪区域在一个更大的帧中, 偏移 (2, 4)
+                const int x = 2, y = 4;
+                Frame f(c.cw + 6, c.ch + 8, nv12 != 0);
+                f.fill(rng, 0);
+                if (mode == 1) {
+                    for (int j = 0; j < f.h; j++) {
+                        for (int i = 0; i < f.w; i++) f.py()[size_t(j) * f.w + i] = (i & 1) ? 255 : 0;
+                    }
+                }
+
+                const uint8_t* src[3] = {f.py(), f.pu(), f.pv()};
+                const int linesize[3] = {f.w, f.uv_stride(), f.cw};
+                pixconv::CropResize resize(x, y, c.cw, c.ch, c.ow, c.oh);
+                std::vector<uint8_t> out(size_t(c.ow) * c.oh * 3 / 2);
+                resize.run(src, linesize, nv12 ? pixconv::Format::NV12 : pixconv::Format::YUV420P, out.data(),
+                           pixconv::Format::YUV420P);
+
+                const int step = f.uv_step();
+                const std::vector<uint8_t> planes[3] = {
+                        resize_ref(f.py() + size_t(y) * f.w + x, f.w, 1, c.cw, c.ch, c.ow, c.oh),
+                        resize_ref(f.pu() + size_t(y / 2) * f.uv_stride() + (x / 2) * step, f.uv_stride(), step,
+                                   c.cw / 2, c.ch / 2, c.ow / 2, c.oh / 2),
+                        resize_ref(f.pv() + size_t(y / 2) * f.uv_stride() + (x / 2) * step, f.uv_stride(), step,
+                                   c.cw / 2, c.ch / 2, c.ow / 2, c.oh / 2)};
+
+                int max_diff = 0;
+                size_t offset = 0;
+                for (const auto& plane : planes) {
+                    for (size_t k = 0; k < plane.size(); k++) {
+                        max_diff = std::max(max_diff, std::abs(int(out[offset + k]) - int(plane[k])));
+                    }
+                    offset += plane.size();
+                }
+                total++;
+                if (max_diff > 1) {
+                    std::printf("MISMATCH resize %s %4dx%-4d -> %4dx%-4d %-7s: max diff %d\n",
+                                nv12 ? "nv12   " : "yuv420p", c.cw, c.ch, c.ow, c.oh, modes[mode], max_diff);
+                    failures++;
+                }
+            }
+        }
+    }
+    std::printf("resize: %d/%d cases within 1 of the swscale bilinear reference\n", total - failures, total);
+    return failures;
+}
+
+static void bench(const std::vector<Kernel>& list, int w, int h, int iterations) {
+    std::mt19937 rng(1);
+    std::vector<uint8_t> dst(size_t(w) * h * 3);
+    std::printf("\n%dx%d, %d iterations, ms per frame\n", w, h, iterations);
+    std::printf("%-8s %10s %10s %10s\n", "kernel", "yuv420p", "nv12", "speedup");
+
+    double base = 0;
+    for (const Kernel& k : list) {
+        double ms[2];
+        for (int nv12 = 0; nv12 < 2; nv12++) {
+            Frame f(w, h, nv12 != 0);
+            f.fill(rng, 0);
+            convert(f, k.row, dst.data(), false);     // warm up
+
+            const auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; i++) convert(f, k.row, dst.data(), false);
+            const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            ms[nv12] = elapsed.count() / iterations;
+        }
+        if (base == 0) base = ms[0];
+        std::printf("%-8s %10.3f %10.3f %9.2fx\n", k.name, ms[0], ms[1], base / ms[0]);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int w = 1920, h = 1080, iterations = 200;
+    if (argc > 1 && std::sscanf(argv[1], "%dx%d", &w, &h) != 2) {
+        std::fprintf(stderr, "pixconv_bench [WxH=1920x1080] [iterations=200]\n");
+        return 1;
+    }
+    if (argc > 2) iterations = std::max(std::atoi(argv[2]), 1);
+
+    const std::vector<Kernel> list = kernels();
+    std::printf("kernels:");
+    for (const Kernel& k : list) std::printf(" %s", k.name);
+    std::printf(", dispatch picks %s\n",
+                std::find_if(list.begin(), list.end(), [](const Kernel& k) { return k.row == pixconv::yuv_row(); })->name);
+
+    const int failures = check(list) + check_resize();
+    bench(list, w, h, iterations);
+    return failures ? 1 : 0;
+}
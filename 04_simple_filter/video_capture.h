@@ -0,0 +1,363 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include "something.h"
+#include "pixconv.h"
+#include "filter_threading.h"
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+}
+
+std::tuple<Size_wh, Size_wh, std::string> get_videofilter_cpu(
+        Size_wh originsize, std::string pix_fmt, std::tuple<int, int, int, int> crop_xywh, Size_wh resize) {
+    static const std::vector<std::string> allowed_pix_fmts = {"rgb24", "bgr24", "yuv420p", "yuvj420p", "nv12", "gray"};
+    assert(std::find(allowed_pix_fmts.begin(), allowed_pix_fmts.end(), pix_fmt) != allowed_pix_fmts.end());
+    int origin_width = originsize.width;
+    int origin_height = originsize.height;
+    int crop_x = std::get<0>(crop_xywh);
+    int crop_y = std::get<1>(crop_xywh);
+    int crop_w = std::get<2>(crop_xywh);
+    int crop_h = std::get<3>(crop_xywh);
+    int resize_width = resize.width;
+    int resize_height = resize.height;
+
+    std::string cropopt;
+    if (crop_w != 0 && crop_h != 0) {
+        assert(crop_x % 2 == 0 && crop_y % 2 == 0 && crop_w % 2 == 0 && crop_h % 2 == 0);
+        assert(crop_w <= origin_width && crop_h <= origin_height);
+        cropopt = "crop=" + std::to_string(crop_w) + ":" + std::to_string(crop_h) +
+                  ":" + std::to_string(crop_x) + ":" + std::to_string(crop_y);
+    } else {
+        crop_w = origin_width;
+        crop_h = origin_height;
+        cropopt = "";
+    }
+    Size_wh cropsize = {crop_w, crop_h};
+    Size_wh final_size_wh = cropsize;
+
+    std::string scaleopt="";
+    std::string padopt="";
+    if (!resize.empty() && (resize_width != 0 || resize_height != 0)) {
+        assert (resize_width % 2 == 0 && resize_height % 2 == 0);
+        final_size_wh = resize;
+        // 与 pixconv::CropResize 相同的滤波器, 快速路径和 filter graph 的输出只差舍入
+        scaleopt = "scale=" + std::to_string(resize_width) + "x" + std::to_string(resize_height) + ":flags=bilinear";
+    }
+
+    std::string pix_fmt_opt = (pix_fmt == "gray") ? "extractplanes=y" : "";
+    std::string filterstr = "";
+    if (!cropopt.empty() || !scaleopt.empty() || !pix_fmt_opt.empty()) {
+        filterstr = "-vf ";
+        if (!cropopt.empty()) filterstr += cropopt + ",";
+        if (!scaleopt.empty()) filterstr += scaleopt + ",";
+        if (!pix_fmt_opt.empty()) filterstr += pix_fmt_opt + ",";
+        filterstr = filterstr.substr(0, filterstr.size() - 1);
+    }
+    return std::make_tuple(cropsize, final_size_wh, filterstr);
+}
+
+std::vector<int> get_outnumpyshape(Size_wh size_wh, std::string pix_fmt) {
+    if (pix_fmt == "bgr24" || pix_fmt == "rgb24") {
+        return {size_wh.height, size_wh.width, 3};
+    } else if (pix_fmt == "gray") {
+        return {size_wh.height, size_wh.width};
+    } else if (pix_fmt == "yuv420p" || pix_fmt == "yuvj420p" || pix_fmt == "nv12") {
+        return {size_wh.height * 3 / 2, size_wh.width};
+    } else {
+        assert(false && "pix_fmt not supported");
+        return {0, 0};
+    }
+}
+
+
+class FFmpegVideoCapture {
+private:
+    AVFormatContext* decoderFmtCtx = nullptr;
+    int videoStreamIndex = -1;
+
+    AVCodecContext* codecContext = nullptr;
+    AVPacket* packet = nullptr;
+    AVFrame* frame = nullptr;
+    AVFilterGraph* filterGraph = nullptr;
+    AVFilterContext* buffersrcCtx = nullptr;
+    AVFilterContext* buffersinkCtx = nullptr;
+    AVFrame* filteredFrame = nullptr;
+    std::vector<uint8_t> outbuf;
+    pixconv::CropResize cropResize;
+    bool sync_index = false;            // seek() 之后由下一帧的 pts 确定 iframe
+
+public:
+    int width = 0;
+    int height = 0;
+    int origin_width = 0;
+    int origin_height = 0;
+    int count = 0;
+    int iframe = -1;
+    double fps = 0;
+    float duration = 0;
+    AVRational fps_r = {60, 1};
+    std::string codecName = "";
+    std::string filename = "";
+    std::string src_pix_fmt = "";
+    std::string tgt_pix_fmt = "";
+    std::tuple<int, int, int, int> crop_xywh = {0, 0, 0, 0};
+    Size_wh size_wh = Size_wh(0, 0);
+    Size_wh resize = Size_wh(0, 0);
+    std::vector<int> outnumpyshape;
+    int bytes_per_frame = 0;
+    bool verbose = true;            // 打印视频信息和滤镜参数
+
+public:
+    // 拷贝视频信息
+    void __copy_videoinfo(VideoInfo &videoInfo){
+        filename = videoInfo.filename;
+        height = origin_height = videoInfo.height;
+        width = origin_width = videoInfo.width;
+        count = videoInfo.count;
+        fps_r = videoInfo.fps_r;
+        fps = videoInfo.fps;
+        duration = videoInfo.duration;
+        codecName = videoInfo.codec;
+        src_pix_fmt = videoInfo.src_pix_fmt;
+        decoderFmtCtx = videoInfo.decoderFmtCtx;
+        videoStreamIndex = videoInfo.videoStreamIndex;
+    }
+
+    FFmpegVideoCapture(const std::string& filename, std::string pix_fmt,
+                       std::tuple<int, int, int, int> crop_xywh = {0, 0, 0, 0},
+                       Size_wh resize = Size_wh(0,0),
+                       const FilterThreading& threading = FilterThreading(), bool verbose = true):
+                       filename(filename), tgt_pix_fmt(pix_fmt), crop_xywh(crop_xywh), resize(resize), verbose(verbose){
+        // 打开输入文件
+        VideoInfo videoInfo(filename.c_str());
+        if (verbose) videoInfo.show();
+        __copy_videoinfo(videoInfo);
+
+        CHECK (width % 2 == 0, "Height must be even");
+        CHECK ( height % 2 == 0, "Width must be even");
+
+        std::tuple<Size_wh, Size_wh, std::string> filter_options = get_videofilter_cpu(
+                {width, height}, tgt_pix_fmt, crop_xywh, resize);
+        size_wh = std::get<1>(filter_options);
+        std::string filterstr = std::get<2>(filter_options);
+        width = size_wh.width;
+        height = size_wh.height;
+
+        // crop + resize + convert 融合为一次遍历
+        if (!resize.empty()) {
+            int crop_x, crop_y, crop_w, crop_h;
+            std::tie(crop_x, crop_y, crop_w, crop_h) = crop_xywh;
+            if (crop_w == 0 || crop_h == 0) {
+                crop_x = crop_y = 0;
+                crop_w = origin_width;
+                crop_h = origin_height;
+            }
+            cropResize = pixconv::CropResize(crop_x, crop_y, crop_w, crop_h, width, height);
+        }
+
+        // 创建 avfilter_graph: "-vf a,b" -> "a,b"
+        filterstr = filterstr.empty() ? "null" : filterstr.substr(std::string("-vf ").size());
+        filterGraph = avfilter_graph_alloc();
+        threading.apply(filterGraph);
+
+
+        // 计算每帧的位数
+        outnumpyshape = get_outnumpyshape(size_wh, tgt_pix_fmt);
+        bytes_per_frame = 1;
+        for (int num : outnumpyshape) {bytes_per_frame *= num;}
+        outbuf.resize(bytes_per_frame);
+
+        // 初始化解码器
+        AVCodecParameters* codecParameters = decoderFmtCtx->streams[videoStreamIndex]->codecpar;
+        const AVCodec* codec = avcodec_find_decoder(codecParameters->codec_id);
+        CHECK (codec,"Unsupported codec!");
+
+        codecContext = avcodec_alloc_context3(codec);
+        CHECK (codecContext,"Failed to allocate codec context.");
+
+        CHECK (avcodec_parameters_to_context(codecContext, codecParameters) >= 0,
+            "Failed to copy codec parameters to context.");
+
+        CHECK (avcodec_open2(codecContext, codec, nullptr) >= 0, "Failed to open codec.");
+
+        packet = av_packet_alloc();
+        frame = av_frame_alloc();
+        filteredFrame = av_frame_alloc();
+
+        // 初始化过滤链
+        init_filter_chain(filterstr.c_str());
+    }
+
+    void init_filter_chain(const char* filterstr) {
+        const AVFilter* buffersrc = avfilter_get_by_name("buffer");
+        const AVFilter* buffersink = avfilter_get_by_name("buffersink");
+        AVFilterInOut* inputs = avfilter_inout_alloc();
+        AVFilterInOut* outputs = avfilter_inout_alloc();
+        char args[512];
+
+        // 设置 buffer 源的参数
+        auto video_stream = decoderFmtCtx->streams[videoStreamIndex];
+        snprintf(args, sizeof(args),
+                 "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
+                 codecContext->width, codecContext->height, codecContext->pix_fmt,
+                 video_stream->time_base.num, video_stream->time_base.den,
+                 video_stream->sample_aspect_ratio.num, video_stream->sample_aspect_ratio.den);
+        if (verbose) std::cout << "filter = " << args << std::endl;
+        CHECK(avfilter_graph_create_filter(&buffersrcCtx, buffersrc, "in", args, nullptr, filterGraph) >= 0,
+              "Failed to create buffer source");
+
+        // 设置 buffer 汇的参数
+        CHECK(avfilter_graph_create_filter(&buffersinkCtx, buffersink, "out", nullptr, nullptr, filterGraph) >= 0,
+              "Failed to create buffer sink");
+        enum AVPixelFormat pix_fmts[] = { av_get_pix_fmt(tgt_pix_fmt.c_str()), AV_PIX_FMT_NONE };
+        CHECK(av_opt_set_int_list(buffersinkCtx, "pix_fmts", pix_fmts, AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN) >= 0,
+              "Failed to set output pixel format");
+
+        // 构建过滤链
+        outputs->name = av_strdup("in");
+        outputs->filter_ctx = buffersrcCtx;
+        outputs->pad_idx = 0;
+        outputs->next = nullptr;
+        inputs->name = av_strdup("out");
+        inputs->filter_ctx = buffersinkCtx;
+        inputs->pad_idx = 0;
+        inputs->next = nullptr;
+        // "in" 和 "out" 由 avfilter_graph_parse_ptr 直接链接
+        CHECK(avfilter_graph_parse_ptr(filterGraph, filterstr, &inputs, &outputs, nullptr) >= 0,
+              "Failed to parse filter graph");
+
+        avfilter_inout_free(&inputs);
+        avfilter_inout_free(&outputs);
+
+        // 配置过滤链
+        CHECK(avfilter_graph_config(filterGraph, nullptr) >= 0,
+              "Failed to configure filter graph");
+    }
+
+    // 析构函数：释放资源
+    ~FFmpegVideoCapture() {
+        av_frame_free(&filteredFrame);
+        av_frame_free(&frame);
+        av_packet_free(&packet);
+        avcodec_free_context(&codecContext);
+        avformat_close_input(&decoderFmtCtx);
+        avfilter_graph_free(&filterGraph);
+    }
+
+    // 读取下一帧
+    bool read(AVFrame*& outFrame) {
+        while (true) {
+            int ret = av_read_frame(decoderFmtCtx, packet);
+            if (ret < 0) {
+                // 如果没有更多数据，则发送 NULL 包来触发解码剩余帧
+                avcodec_send_packet(codecContext, nullptr);
+            } else if (packet->stream_index == videoStreamIndex) {
+                // 发送视频流数据包到解码器
+                avcodec_send_packet(codecContext, packet);
+            } else if (packet->stream_index != videoStreamIndex) {
+                av_packet_unref(packet);
+                continue;
+            }
+
+            av_packet_unref(packet);
+
+            // 接收解码的帧
+            ret = avcodec_receive_frame(codecContext, frame);
+            if (ret == 0) {
+                outFrame = frame;
+                iframe = sync_index ? frame_index_of(frame) : iframe + 1;
+                sync_index = false;
+                return true;
+            } else if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                if (ret == AVERROR_EOF) return false; // 数据读取完成
+                continue;
+            } else {
+                return false;
+            }
+        }
+    }
+
+    // 定位到 frame_index 之前 (含) 最近的关键帧; 之后 read() 从该关键帧开始, iframe 为其帧号,
+    // 调用者读到 iframe == frame_index 即可, 中间的帧可以缓存 (一个 GOP)
+    bool seek(int frame_index) {
+        if (fps_r.num <= 0 || fps_r.den <= 0) return false;
+        const AVStream* stream = decoderFmtCtx->streams[videoStreamIndex];
+        int64_t start = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+        int64_t ts = start + av_rescale_q(frame_index, av_inv_q(fps_r), stream->time_base);
+        if (av_seek_frame(decoderFmtCtx, videoStreamIndex, ts, AVSEEK_FLAG_BACKWARD) < 0) return false;
+
+        avcodec_flush_buffers(codecContext);
+        iframe = frame_index - 1;
+        sync_index = true;
+        return true;
+    }
+
+    int frame_index_of(const AVFrame* f) const {
+        const AVStream* stream = decoderFmtCtx->streams[videoStreamIndex];
+        if (f->best_effort_timestamp == AV_NOPTS_VALUE || fps_r.num <= 0 || fps_r.den <= 0) return iframe + 1;
+        int64_t start = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+        return int(av_rescale_q_rnd(f->best_effort_timestamp - start, stream->time_base, av_inv_q(fps_r),
+                                    AVRounding(AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX)));
+    }
+
+    // 由 pixconv 直接裁剪 (+ 缩放) + 转换，跳过 filter graph
+    bool convert_fast(const AVFrame* src, uint8_t* dst) {
+        pixconv::Format src_fmt, dst_fmt;
+        if (src->format == AV_PIX_FMT_YUV420P || src->format == AV_PIX_FMT_YUVJ420P) src_fmt = pixconv::Format::YUV420P;
+        else if (src->format == AV_PIX_FMT_NV12) src_fmt = pixconv::Format::NV12;
+        else return false;
+        if (!pixconv::parse_format(tgt_pix_fmt, dst_fmt)) return false;
+
+        // the kernels are limited range only
+        const bool full_range = src->format == AV_PIX_FMT_YUVJ420P || src->color_range == AVCOL_RANGE_JPEG;
+        if (full_range && (dst_fmt == pixconv::Format::BGR24 || dst_fmt == pixconv::Format::RGB24)) return false;
+
+        int crop_x = std::get<0>(crop_xywh), crop_y = std::get<1>(crop_xywh);
+        int crop_w = std::get<2>(crop_xywh), crop_h = std::get<3>(crop_xywh);
+        if (crop_w == 0 || crop_h == 0) {
+            crop_x = crop_y = 0;
+            crop_w = src->width;
+            crop_h = src->height;
+        }
+        if (crop_x + crop_w > src->width || crop_y + crop_h > src->height) return false;
+
+        if (!resize.empty()) {
+            return cropResize.run(src->data, src->linesize, src_fmt, dst, dst_fmt);
+        }
+        return pixconv::convert(src->data, src->linesize, src_fmt, crop_x, crop_y, crop_w, crop_h, dst, dst_fmt);
+    }
+
+    // 读取下一帧，转换为 tgt_pix_fmt 并按 outnumpyshape 紧密排列
+    bool read(uint8_t*& framebuf){ //allocated frame
+        AVFrame* avframe = nullptr;
+        while (read(avframe)) {
+            if (convert_fast(avframe, outbuf.data())) {
+                framebuf = outbuf.data();
+                return true;
+            }
+
+            CHECK(av_buffersrc_add_frame_flags(buffersrcCtx, avframe, AV_BUFFERSRC_FLAG_KEEP_REF) >= 0,
+                  "Failed to feed the filter graph");
+            av_frame_unref(filteredFrame);
+            int ret = av_buffersink_get_frame(buffersinkCtx, filteredFrame);
+            if (ret == AVERROR(EAGAIN)) continue;
+            if (ret < 0) return false;
+
+            av_image_copy_to_buffer(outbuf.data(), bytes_per_frame,
+                                    filteredFrame->data, filteredFrame->linesize,
+                                    (AVPixelFormat)filteredFrame->format, width, height, 1);
+            framebuf = outbuf.data();
+            return true;
+        }
+        return false;
+    }
+};
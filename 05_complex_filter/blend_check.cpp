@@ -0,0 +1,55 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "watermark.h"
+
+// WatermarkOverlay::blend_row (SSE2 where available, scalar tail) against the scalar formula, bit for bit, and
+// against the exact blend round((color * a + dst * (255 - a)) / 255), within 1; every dst, color and alpha,
+// 255 pixels per row (15 SIMD steps and a 15 pixel tail) from an odd address
+
+int main()
+{
+    const int n = 255;
+    std::vector<uint8_t> dst(n + 1), color(n + 1), inv_alpha(n + 1);
+
+    int64_t mismatches = 0, off_by_more = 0;
+    for (int a = 0; a < 256; a++) {
+        for (int c = 0; c < 256; c++) {
+            const uint8_t premultiplied = (uint8_t)((c * a + 127) / 255);
+            for (int i = 0; i < n; i++) {
+                dst[i + 1] = (uint8_t)(i + (c & 1));     // 0..254, 1..255 for odd colors
+                color[i + 1] = premultiplied;
+                inv_alpha[i + 1] = (uint8_t)(255 - a);
+            }
+
+            std::vector<uint8_t> expected(n);
+            for (int i = 0; i < n; i++) {
+                int t = dst[i + 1] * (255 - a) + 128;
+                t = (t + (t >> 8)) >> 8;
+                expected[i] = (uint8_t)std::min(255, t + premultiplied);
+            }
+
+            WatermarkOverlay::blend_row(dst.data() + 1, color.data() + 1, inv_alpha.data() + 1, n);
+
+            for (int i = 0; i < n; i++) {
+                const int d = i + (c & 1);
+                const int exact = (c * a + d * (255 - a) + 127) / 255;
+                if (dst[i + 1] != expected[i] && mismatches++ < 10) {
+                    std::printf("MISMATCH a = %3d, color = %3d, dst = %3d: %3d != %3d\n", a, c, d, dst[i + 1], expected[i]);
+                }
+                if (std::abs(dst[i + 1] - exact) > 1 && off_by_more++ < 10) {
+                    std::printf("INEXACT  a = %3d, color = %3d, dst = %3d: %3d, exact %3d\n", a, c, d, dst[i + 1], exact);
+                }
+            }
+        }
+    }
+
+#ifdef WATERMARK_SSE2
+    const char * kernel = "sse2";
+#else
+    const char * kernel = "scalar";
+#endif
+    std::printf("blend_row (%s): %lld mismatches against the scalar formula, %lld off the exact blend by more than 1\n",
+                kernel, (long long)mismatches, (long long)off_by_more);
+    return (mismatches || off_by_more) ? 1 : 0;
+}
@@ -23,8 +23,6 @@ public:
     Decoder()
     {
         packet_ = av_packet_alloc();
-        video_frame_ = av_frame_alloc();
-        audio_frame_ = av_frame_alloc();
     }
     Decoder(const Decoder&) = delete;
     Decoder& operator=(const Decoder&) = delete;
@@ -37,47 +35,68 @@ public:
         avcodec_free_context(&audio_decode_ctx_);
 
         av_packet_free(&packet_);
-        av_frame_free(&video_frame_);
-        av_frame_free(&audio_frame_);
     }
 
-    int open(const std::string& filename)
+    // the audio stream is only decoded on request, nobody would drain its frames otherwise
+    int open(const std::string& filename, bool with_audio = false)
     {
         LOG(INFO) << filename;
         CHECK(avformat_open_input(&fmt_ctx_, filename.c_str(), nullptr, nullptr) >= 0);
         CHECK(avformat_find_stream_info(fmt_ctx_, nullptr) >= 0);
 
         video_stream_idx_ = av_find_best_stream(fmt_ctx_, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
-        audio_stream_idx_ = av_find_best_stream(fmt_ctx_, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+        audio_stream_idx_ = with_audio ? av_find_best_stream(fmt_ctx_, AVMEDIA_TYPE_AUDIO, -1, video_stream_idx_, nullptr, 0) : -1;
+        video_stream_idx_ = std::max(video_stream_idx_, -1);
+        audio_stream_idx_ = std::max(audio_stream_idx_, -1);
         CHECK(video_stream_idx_ >= 0 || audio_stream_idx_ >= 0);
 
-        // decoder
-        LOG(INFO) << fmt_ctx_->streams[video_stream_idx_]->codecpar->codec_id;
-        auto video_decoder = avcodec_find_decoder(fmt_ctx_->streams[video_stream_idx_]->codecpar->codec_id);
-        CHECK_NOTNULL(video_decoder);
+        if (video_stream_idx_ >= 0) video_decode_ctx_ = open_decoder(video_stream_idx_);
+        if (audio_stream_idx_ >= 0) audio_decode_ctx_ = open_decoder(audio_stream_idx_);
+
+        av_dump_format(fmt_ctx_, 0, filename.c_str(), 0);
+        if (video_stream_idx_ >= 0) {
+            LOG(INFO) << fmt::format("[ INPUT] {}: {}x{}, fps = {}/{}, tbr = {}/{}, tbc = {}/{}, tbn = {}/{}\n",
+                                     filename,
+                                     video_decode_ctx_->width, video_decode_ctx_->height,
+                                     fmt_ctx_->streams[video_stream_idx_]->avg_frame_rate.num, fmt_ctx_->streams[video_stream_idx_]->avg_frame_rate.den,
+                                     fmt_ctx_->streams[video_stream_idx_]->r_frame_rate.num, fmt_ctx_->streams[video_stream_idx_]->r_frame_rate.den,
+                                     video_decode_ctx_->time_base.num, video_decode_ctx_->time_base.den,
+                                     fmt_ctx_->streams[video_stream_idx_]->time_base.num, fmt_ctx_->streams[video_stream_idx_]->time_base.den);
+        }
+        if (audio_stream_idx_ >= 0) {
+            LOG(INFO) << fmt::format("[ INPUT] {}: {} Hz, {} channels, {}, tbn = {}/{}\n",
+                                     filename,
+                                     audio_decode_ctx_->sample_rate, audio_decode_ctx_->channels,
+                                     av_get_sample_fmt_name(audio_decode_ctx_->sample_fmt),
+                                     fmt_ctx_->streams[audio_stream_idx_]->time_base.num, fmt_ctx_->streams[audio_stream_idx_]->time_base.den);
+        }
+
+        return 0;
+    }
+
+    AVCodecContext * open_decoder(int stream_idx)
+    {
+        auto stream = fmt_ctx_->streams[stream_idx];
+        LOG(INFO) << stream->codecpar->codec_id;
+        auto decoder = avcodec_find_decoder(stream->codecpar->codec_id);
+        CHECK_NOTNULL(decoder);
 
         // decoder context
-        video_decode_ctx_ = avcodec_alloc_context3(video_decoder);
-        CHECK_NOTNULL(video_decode_ctx_);
+        auto decode_ctx = avcodec_alloc_context3(decoder);
+        CHECK_NOTNULL(decode_ctx);
 
-        CHECK(avcodec_parameters_to_context(video_decode_ctx_, fmt_ctx_->streams[video_stream_idx_]->codecpar) >= 0);
+        CHECK(avcodec_parameters_to_context(decode_ctx, stream->codecpar) >= 0);
+        decode_ctx->pkt_timebase = stream->time_base;
 
         AVDictionary * decoder_options = nullptr;
         av_dict_set(&decoder_options, "threads", "auto", AV_DICT_DONT_OVERWRITE);
-        CHECK(avcodec_open2(video_decode_ctx_, video_decoder, &decoder_options) >= 0);
-
-        av_dump_format(fmt_ctx_, 0, filename.c_str(), 0);
-        LOG(INFO) << fmt::format("[ INPUT] {}: {}x{}, fps = {}/{}, tbr = {}/{}, tbc = {}/{}, tbn = {}/{}\n",
-                                 filename,
-                                 video_decode_ctx_->width, video_decode_ctx_->height,
-                                 fmt_ctx_->streams[video_stream_idx_]->avg_frame_rate.num, fmt_ctx_->streams[video_stream_idx_]->avg_frame_rate.den,
-                                 fmt_ctx_->streams[video_stream_idx_]->r_frame_rate.num, fmt_ctx_->streams[video_stream_idx_]->r_frame_rate.den,
-                                 video_decode_ctx_->time_base.num, video_decode_ctx_->time_base.den,
-                                 fmt_ctx_->streams[video_stream_idx_]->time_base.num, fmt_ctx_->streams[video_stream_idx_]->time_base.den);
+        defer(av_dict_free(&decoder_options));
+        CHECK(avcodec_open2(decode_ctx, decoder, &decoder_options) >= 0);
 
-        return 0;
+        return decode_ctx;
     }
 
+    // demuxes on the calling thread, the video and the audio stream are decoded in parallel on their own threads
     void decode_thread()
     {
         LOG(INFO) << "[DECODER THREAD @ " << std::this_thread::get_id() << "] START";
@@ -86,72 +105,124 @@ public:
         if (video_stream_idx_ < 0) eof_ |= 0x01;
         if (audio_stream_idx_ < 0) eof_ |= 0x02;
 
-        while(running_ && !(eof_ & 0b0100)) {
-            if (video_frame_buffer_.full() || audio_frame_buffer_.full()) {
-                av_usleep(20000);
-                continue;
-            }
+        std::thread video_thread;
+        std::thread audio_thread;
+        if (video_stream_idx_ >= 0) {
+            video_thread = std::thread([this]() { stream_decode_thread(video_decode_ctx_, video_packet_buffer_, video_frame_buffer_, 0x01); });
+        }
+        if (audio_stream_idx_ >= 0) {
+            audio_thread = std::thread([this]() { stream_decode_thread(audio_decode_ctx_, audio_packet_buffer_, audio_frame_buffer_, 0x02); });
+        }
 
+        while(running_) {
             av_packet_unref(packet_);
             int ret = av_read_frame(fmt_ctx_, packet_);
             if (ret < 0) {
-                if ((ret == AVERROR_EOF || avio_feof(fmt_ctx_->pb)) && !(eof_ & 0b0100)) {
+                if (ret == AVERROR_EOF || avio_feof(fmt_ctx_->pb)) {
                     LOG(INFO) << "[DECODER THREAD] PUT NULL PACKET TO FLUSH DECODERS";
-                    av_packet_unref(packet_);
-                    eof_ |= 0b0100;
                 }
                 else {
                     LOG(ERROR) << "[DECODER THREAD] read frame failed";
-                    break;
                 }
+                break;
             }
 
-            // video packet
-            if (packet_->stream_index == video_stream_idx_ || (eof_ & 0b0100)) {
-                ret = avcodec_send_packet(video_decode_ctx_, packet_);
-                while (ret >= 0) {
-                    av_frame_unref(video_frame_);
-                    ret = avcodec_receive_frame(video_decode_ctx_, video_frame_);
-                    if (ret == AVERROR(EAGAIN)) {
-                        break;
-                    }
-                    else if (ret == AVERROR_EOF) { // fully flushed, exit
-                        LOG(INFO) << "[DECODER THREAD @ " << std::this_thread::get_id() << "] VIDEO EOF";
-                        eof_ |= 0x01;
-                        break;
-                    }
-                    else if (ret < 0) { // error, exit
-                        LOG(ERROR) << "[DECODER THREAD @ " << std::this_thread::get_id() << "] legitimate decoding errors";
-                        running_ = false;
-                        break;
-                    }
-
-                    LOG(INFO) << "[DECODER THREAD @ " << std::this_thread::get_id() << "] pts = " << video_frame_->pts
-                              << ", frame = " << video_decode_ctx_->frame_number;
-
-                    while (video_frame_buffer_.full() && running_) {
-                        av_usleep(20000);
-                    }
-                    video_frame_buffer_.push([this](AVFrame *frame) {
-                        av_frame_unref(frame);
-                        av_frame_move_ref(frame, video_frame_);
-                    });
-                }
+            if (packet_->stream_index == video_stream_idx_) {
+                push_packet(video_packet_buffer_, packet_);
             }
-
-            // audio packet
-            if(packet_->stream_index == audio_stream_idx_ || (eof_ & 0b0100)) {
-                // TODO:
+            else if (packet_->stream_index == audio_stream_idx_) {
+                push_packet(audio_packet_buffer_, packet_);
             }
         }
+        eof_ |= 0b0100;
+
+        // an empty packet flushes the decoder, which then closes its frame buffer
+        av_packet_unref(packet_);
+        if (video_stream_idx_ >= 0) push_packet(video_packet_buffer_, packet_);
+        if (audio_stream_idx_ >= 0) push_packet(audio_packet_buffer_, packet_);
 
-        if (video_stream_idx_ >= 0) video_frame_buffer_.push([](AVFrame *nil) { av_frame_unref(nil); });
-        if (audio_stream_idx_ >= 0) audio_frame_buffer_.push([](AVFrame *nil) { av_frame_unref(nil); });
+        if (video_thread.joinable()) video_thread.join();
+        if (audio_thread.joinable()) audio_thread.join();
 
         running_ = false;
         eof_ = 0b0111;
     }
 
+    template<int P, int F>
+    void stream_decode_thread(AVCodecContext * decode_ctx, RingVector<AVPacket*, P>& packets, RingVector<AVFrame*, F>& frames, uint8_t eof_bit)
+    {
+        const char * type = av_get_media_type_string(decode_ctx->codec_type);
+        LOG(INFO) << "[DECODER THREAD @ " << std::this_thread::get_id() << "] " << type << " START";
+        defer(LOG(INFO) << "[DECODER THREAD @ " << std::this_thread::get_id() << "] " << type << " EXITED");
+
+        AVPacket * packet = av_packet_alloc();
+        AVFrame * frame = av_frame_alloc();
+        defer(av_packet_free(&packet); av_frame_free(&frame));
+
+        bool eof = false;
+        while (!eof) {
+            // the demuxer always ends with an empty packet, even when stopped
+            if (!packets.wait_not_empty(std::chrono::milliseconds(100))) {
+                continue;
+            }
+
+            packets.pop([packet](AVPacket * popped) {
+                av_packet_unref(packet);
+                av_packet_move_ref(packet, popped);
+            });
+
+            const bool flushing = !packet->data && !packet->size;
+            int ret = avcodec_send_packet(decode_ctx, flushing ? nullptr : packet);
+            if (ret < 0) {
+                LOG(WARNING) << "[DECODER THREAD @ " << std::this_thread::get_id() << "] " << type << " avcodec_send_packet()";
+                eof = flushing;
+            }
+
+            while (ret >= 0) {
+                av_frame_unref(frame);
+                ret = avcodec_receive_frame(decode_ctx, frame);
+                if (ret == AVERROR(EAGAIN)) {
+                    break;
+                }
+                else if (ret == AVERROR_EOF) { // fully flushed, exit
+                    LOG(INFO) << "[DECODER THREAD @ " << std::this_thread::get_id() << "] " << type << " EOF";
+                    eof = true;
+                    break;
+                }
+                else if (ret < 0) { // error, exit
+                    LOG(ERROR) << "[DECODER THREAD @ " << std::this_thread::get_id() << "] legitimate decoding errors";
+                    running_ = false;
+                    break;
+                }
+
+                LOG(INFO) << "[DECODER THREAD @ " << std::this_thread::get_id() << "] " << type << " pts = " << frame->pts
+                          << ", frame = " << decode_ctx->frame_number;
+
+                while (!frames.wait_not_full(std::chrono::milliseconds(20)) && running_) {
+                }
+                frames.push([frame](AVFrame * queued) {
+                    av_frame_unref(queued);
+                    av_frame_move_ref(queued, frame);
+                });
+            }
+        }
+
+        frames.push([](AVFrame * nil) { av_frame_unref(nil); });
+        eof_ |= eof_bit;
+    }
+
+    // blocks while the decoder is behind, unless stopped
+    template<int P>
+    void push_packet(RingVector<AVPacket*, P>& packets, AVPacket * packet)
+    {
+        while (!packets.wait_not_full(std::chrono::milliseconds(20)) && running_) {
+        }
+        packets.push([packet](AVPacket * queued) {
+            av_packet_unref(queued);
+            av_packet_move_ref(queued, packet);
+        });
+    }
+
     std::string filter_args()
     {
         auto video_stream = fmt_ctx_->streams[video_stream_idx_];
@@ -163,6 +234,17 @@ public:
         );
     }
 
+    std::string audio_filter_args()
+    {
+        auto audio_stream = fmt_ctx_->streams[audio_stream_idx_];
+        return fmt::format(
+                "time_base={}/{}:sample_rate={}:sample_fmt={}:channel_layout=0x{:x}",
+                audio_stream->time_base.num, audio_stream->time_base.den,
+                audio_decode_ctx_->sample_rate, av_get_sample_fmt_name(audio_decode_ctx_->sample_fmt),
+                audio_decode_ctx_->channel_layout ? audio_decode_ctx_->channel_layout : av_get_default_channel_layout(audio_decode_ctx_->channels)
+        );
+    }
+
     bool eof() const { return eof_ == 0b0111; }
 
 //private:
@@ -176,10 +258,20 @@ public:
     AVCodecContext * video_decode_ctx_{nullptr};
     AVCodecContext * audio_decode_ctx_{nullptr};
 
-    AVPacket *packet_{nullptr};
-    AVFrame * video_frame_{nullptr};
-    AVFrame * audio_frame_{nullptr};
+    AVPacket *packet_{nullptr};     // demux thread
+
+    // demux thread -> decode threads, an empty packet closes the stream
+    RingVector<AVPacket*, 32> video_packet_buffer_{
+            []() { return av_packet_alloc(); },
+            [](AVPacket** packet) { av_packet_free(packet); }
+    };
+
+    RingVector<AVPacket*, 64> audio_packet_buffer_{
+            []() { return av_packet_alloc(); },
+            [](AVPacket** packet) { av_packet_free(packet); }
+    };
 
+    // decode threads -> filter, an empty frame closes the stream
     RingVector<AVFrame*, 3> video_frame_buffer_{
             []() { return av_frame_alloc(); },
             [](AVFrame** frame) { av_frame_free(frame); }
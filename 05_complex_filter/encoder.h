@@ -1,10 +1,12 @@
 #ifndef _05_ENCODER_H
 #define _05_ENCODER_H
 
+#include <cstdlib>
 #include <vector>
 #include <string>
 #include <thread>
 #include <atomic>
+#include <mutex>
 
 extern "C" {
 #include <libavformat/avformat.h>
@@ -18,28 +20,26 @@ extern "C" {
 #include "ringvector.h"
 #include "fmt/format.h"
 
-
+// encode_frame() / encode_audio_frame() only queue the frame: each stream is encoded on its own encode thread,
+// and the packets are written by the mux thread, so filtering, encoding and muxing overlap
 class Encoder {
 public:
-    Encoder()
-    {
-        packet_ = av_packet_alloc();
-    }
+    Encoder() = default;
+    Encoder(const Encoder&) = delete;
+    Encoder& operator=(const Encoder&) = delete;
+
     ~Encoder()
     {
-        av_write_trailer(fmt_ctx_);
-
-        avformat_free_context(fmt_ctx_);
-        if (fmt_ctx_ && !(fmt_ctx_->oformat->flags & AVFMT_NOFILE))
-            avio_closep(&fmt_ctx_->pb);
+        close();
 
         avcodec_free_context(&video_encode_ctx_);
         avcodec_free_context(&audio_encode_ctx_);
-
-        av_packet_free(&packet_);
     }
 
-    int open(const std::string& filename, int w, int h, AVPixelFormat format, AVRational sar, AVRational framerate, AVRational time_base)
+    // @sample_rate = 0: video only; @audio_time_base: of the audio frames passed to encode_audio_frame()
+    int open(const std::string& filename, int w, int h, AVPixelFormat format, AVRational sar, AVRational framerate, AVRational time_base,
+             int sample_rate = 0, uint64_t channel_layout = 0, AVSampleFormat sample_fmt = AV_SAMPLE_FMT_NONE,
+             AVRational audio_time_base = { 1, 0 })
     {
         CHECK(avformat_alloc_output_context2(&fmt_ctx_, nullptr, nullptr, filename.c_str()) >= 0);
 
@@ -74,6 +74,11 @@ public:
         CHECK(avcodec_open2(video_encode_ctx_, video_encoder, &encoder_options) >= 0);
         CHECK(avcodec_parameters_from_context(fmt_ctx_->streams[video_stream_idx_]->codecpar, video_encode_ctx_) >= 0);
 
+        if (sample_rate > 0) {
+            open_audio(sample_rate, channel_layout, sample_fmt);
+            audio_time_base_ = audio_time_base.den > 0 ? audio_time_base : audio_encode_ctx_->time_base;
+        }
+
         if(!(fmt_ctx_->oformat->flags & AVFMT_NOFILE)) {
             CHECK(avio_open(&fmt_ctx_->pb, filename.c_str(), AVIO_FLAG_WRITE) >= 0);
         }
@@ -81,45 +86,245 @@ public:
         CHECK(avformat_write_header(fmt_ctx_, nullptr) >= 0);
 
         av_dump_format(fmt_ctx_, 0, filename.c_str(), 1);
+
+        video_thread_ = std::thread([this]() { encode_thread(video_encode_ctx_, video_stream_idx_, video_frame_buffer_); });
+        if (audio_encode_ctx_) {
+            audio_thread_ = std::thread([this]() { encode_thread(audio_encode_ctx_, audio_stream_idx_, audio_frame_buffer_); });
+        }
+        mux_thread_ = std::thread([this]() { mux_thread(); });
         return 0;
     }
 
+    void open_audio(int sample_rate, uint64_t channel_layout, AVSampleFormat sample_fmt)
+    {
+        CHECK_NOTNULL(avformat_new_stream(fmt_ctx_, nullptr));
+        audio_stream_idx_ = 1;
+
+        auto audio_encoder = avcodec_find_encoder_by_name("aac");
+        CHECK_NOTNULL(audio_encoder);
+        audio_encode_ctx_ = avcodec_alloc_context3(audio_encoder);
+        CHECK_NOTNULL(audio_encode_ctx_);
+
+        audio_encode_ctx_->sample_rate = sample_rate;
+        audio_encode_ctx_->channel_layout = channel_layout;
+        audio_encode_ctx_->channels = av_get_channel_layout_nb_channels(channel_layout);
+        audio_encode_ctx_->sample_fmt = sample_fmt;
+        audio_encode_ctx_->bit_rate = 128000;
+
+        audio_encode_ctx_->time_base = { 1, sample_rate };
+        fmt_ctx_->streams[audio_stream_idx_]->time_base = audio_encode_ctx_->time_base;
+
+        if (fmt_ctx_->oformat->flags & AVFMT_GLOBALHEADER) {
+            audio_encode_ctx_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
+
+        CHECK(avcodec_open2(audio_encode_ctx_, audio_encoder, nullptr) >= 0);
+        CHECK(avcodec_parameters_from_context(fmt_ctx_->streams[audio_stream_idx_]->codecpar, audio_encode_ctx_) >= 0);
+    }
+
+    // 0 if the audio encoder takes any number of samples per frame
+    int audio_frame_size() const
+    {
+        if (!audio_encode_ctx_ || (audio_encode_ctx_->codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE)) return 0;
+        return audio_encode_ctx_->frame_size;
+    }
+
+    // queue a reference to the frame, blocks while the encoder is @video_frame_buffer_ frames behind.
+    // an empty frame (width = height = 0) flushes the encoder and closes the stream
     int encode_frame(AVFrame * frame)
     {
-        frame->pict_type = AV_PICTURE_TYPE_NONE;
+        return queue_frame(video_frame_buffer_, video_flushing_, frame, !frame->width && !frame->height);
+    }
 
-        if((!frame->width && !frame->height))
-            LOG(INFO) << "[ENCODER] NULL";
+    // the same for the audio stream, an empty frame has nb_samples = 0. The pts is rescaled to 1/sample_rate: the frames
+    // of a single input keep the time base of its demuxer (anull), e.g. 1/1000 for mkv and flv or 1/90000 for ts
+    int encode_audio_frame(AVFrame * frame)
+    {
+        if (!audio_encode_ctx_) return -1;
+
+        if (frame->nb_samples && frame->pts != AV_NOPTS_VALUE) {
+            frame->pts = av_rescale_q(frame->pts, audio_time_base_, audio_encode_ctx_->time_base);
+
+            // the sink cuts the audio into contiguous frames, a jump means the timestamps are off
+            if (next_audio_pts_ != AV_NOPTS_VALUE && std::abs(frame->pts - next_audio_pts_) > frame->nb_samples) {
+                LOG(WARNING) << fmt::format("[ENCODER] audio pts = {}, expected {}", frame->pts, next_audio_pts_);
+            }
+            next_audio_pts_ = frame->pts + frame->nb_samples;
+        }
+        return queue_frame(audio_frame_buffer_, audio_flushing_, frame, !frame->nb_samples);
+    }
+
+    // flush if the caller did not, wait for the threads, then finish the file
+    int close()
+    {
+        if (!fmt_ctx_) return error_ ? -1 : 0;
+
+        if (video_thread_.joinable()) flush(video_frame_buffer_, video_flushing_);
+        if (audio_thread_.joinable()) flush(audio_frame_buffer_, audio_flushing_);
+
+        if (video_thread_.joinable()) video_thread_.join();
+        if (audio_thread_.joinable()) audio_thread_.join();
+        if (mux_thread_.joinable()) mux_thread_.join();
+
+        // the trailer still needs the io context, which must be closed before the format context is freed
+        if (av_write_trailer(fmt_ctx_) < 0) {
+            LOG(ERROR) << "av_write_trailer()";
+            error_ = true;
+        }
+
+        if (!(fmt_ctx_->oformat->flags & AVFMT_NOFILE))
+            avio_closep(&fmt_ctx_->pb);
+
+        avformat_free_context(fmt_ctx_);
+        fmt_ctx_ = nullptr;
 
-        int ret = avcodec_send_frame(video_encode_ctx_, (!frame->width && !frame->height) ? nullptr : frame);
-        while(ret >= 0) {
-            av_packet_unref(packet_);
-            ret = avcodec_receive_packet(video_encode_ctx_, packet_);
+        return error_ ? -1 : 0;
+    }
+
+    template<int N>
+    void encode_thread(AVCodecContext * encode_ctx, int stream_idx, RingVector<AVFrame*, N>& frames)
+    {
+        const char * type = av_get_media_type_string(encode_ctx->codec_type);
+        LOG(INFO) << "[ENCODE THREAD @ " << std::this_thread::get_id() << "] " << type << " START";
+        defer(LOG(INFO) << "[ENCODE THREAD @ " << std::this_thread::get_id() << "] " << type << " EXITED");
 
-            if(ret == AVERROR(EAGAIN)) {
-                break;
+        AVFrame * frame = av_frame_alloc();
+        AVPacket * packet = av_packet_alloc();
+        defer(av_frame_free(&frame); av_packet_free(&packet));
+
+        bool eof = false;
+        while (!eof) {
+            if (!frames.wait_not_empty(std::chrono::milliseconds(100))) {
+                continue;
             }
-            else if (ret == AVERROR_EOF) {
-                LOG(INFO) << "[ENCODER] EOF";
-                break;
+
+            frames.pop([frame](AVFrame * popped) {
+                av_frame_unref(frame);
+                av_frame_move_ref(frame, popped);
+            });
+            eof = !frame->width && !frame->height && !frame->nb_samples;
+
+            // after an error the queue is only drained, so that the producers never block forever
+            if (error_) continue;
+
+            frame->pict_type = AV_PICTURE_TYPE_NONE;
+            int ret = avcodec_send_frame(encode_ctx, eof ? nullptr : frame);
+            av_frame_unref(frame);
+            if (ret < 0) {
+                LOG(ERROR) << "avcodec_send_frame()";
+                error_ = true;
+            }
+
+            while(ret >= 0) {
+                av_packet_unref(packet);
+                ret = avcodec_receive_packet(encode_ctx, packet);
+
+                if(ret == AVERROR(EAGAIN)) {
+                    break;
+                }
+                else if (ret == AVERROR_EOF) {
+                    LOG(INFO) << "[ENCODER] " << type << " EOF";
+                    break;
+                }
+                else if(ret < 0) {
+                    LOG(ERROR) << "avcodec_receive_packet()";
+                    error_ = true;
+                    break;
+                }
+
+                packet->stream_index = stream_idx;
+                LOG(INFO) << fmt::format("[ENCODER] {} pts = {}, frame = {}", type, packet->pts, encode_ctx->frame_number);
+                av_packet_rescale_ts(packet, encode_ctx->time_base, fmt_ctx_->streams[stream_idx]->time_base);
+
+                push_packet(packet);
             }
-            else if(ret < 0) {
-                LOG(ERROR) << "avcodec_receive_packet()";
-                return -1;
+        }
+
+        // an empty packet tells the mux thread that this stream is finished
+        av_packet_unref(packet);
+        push_packet(packet);
+    }
+
+    void mux_thread()
+    {
+        LOG(INFO) << "[MUX THREAD @ " << std::this_thread::get_id() << "] START";
+        defer(LOG(INFO) << "[MUX THREAD @ " << std::this_thread::get_id() << "] EXITED");
+
+        AVPacket * packet = av_packet_alloc();
+        defer(av_packet_free(&packet));
+
+        int nb_streams = audio_encode_ctx_ ? 2 : 1;
+        while (nb_streams > 0) {
+            if (!packet_buffer_.wait_not_empty(std::chrono::milliseconds(100))) {
+                continue;
             }
 
-            packet_->stream_index = video_stream_idx_;
-            LOG(INFO) << fmt::format("[ENCODER] pts = {}, frame = {}", packet_->pts, video_encode_ctx_->frame_number);
-            av_packet_rescale_ts(packet_, video_encode_ctx_->time_base, fmt_ctx_->streams[video_stream_idx_]->time_base);
+            packet_buffer_.pop([packet](AVPacket * popped) {
+                av_packet_unref(packet);
+                av_packet_move_ref(packet, popped);
+            });
 
-            if (av_interleaved_write_frame(fmt_ctx_, packet_) != 0) {
+            if (!packet->data && !packet->size) {
+                nb_streams--;
+                continue;
+            }
+
+            // interleaves the audio and the video packets by dts
+            if (!error_ && av_interleaved_write_frame(fmt_ctx_, packet) != 0) {
                 LOG(ERROR) << "av_interleaved_write_frame()";
-                return -1;
+                error_ = true;
             }
         }
+    }
+
+    template<int N>
+    int queue_frame(RingVector<AVFrame*, N>& frames, std::atomic<bool>& flushing, AVFrame * frame, bool eof)
+    {
+        if (error_ || flushing) return -1;
+
+        if (eof) {
+            LOG(INFO) << "[ENCODER] NULL";
+            flushing = true;
+        }
+
+        // single producer per stream: nothing can fill the queue between the wait and the push
+        while (!frames.wait_not_full(std::chrono::milliseconds(20))) {
+        }
+
+        int ret = 0;
+        frames.push([&](AVFrame * queued) {
+            av_frame_unref(queued);
+            if (!eof) ret = av_frame_ref(queued, frame);
+        });
+        return ret < 0 ? -1 : 0;
+    }
+
+    template<int N>
+    void flush(RingVector<AVFrame*, N>& frames, std::atomic<bool>& flushing)
+    {
+        if (flushing) return;
+
+        flushing = true;
+        while (!frames.wait_not_full(std::chrono::milliseconds(20))) {
+        }
+        frames.push([](AVFrame * nil) { av_frame_unref(nil); });
+    }
+
+    // both encode threads push, so the wait and the push must not interleave
+    void push_packet(AVPacket * packet)
+    {
+        std::lock_guard<std::mutex> lock(packet_mtx_);
+        while (!packet_buffer_.wait_not_full(std::chrono::milliseconds(20))) {
+        }
 
-        return ret;
+        packet_buffer_.push([packet](AVPacket * queued) {
+            av_packet_unref(queued);
+            av_packet_move_ref(queued, packet);
+        });
     }
+
+    bool error() const { return error_; }
+
 //private:
     AVFormatContext * fmt_ctx_{nullptr};
     AVCodecContext * video_encode_ctx_{nullptr};
@@ -127,8 +332,33 @@ public:
 
     int video_stream_idx_{ 0 };
     int audio_stream_idx_{ -1 };
+    AVRational audio_time_base_{ 1, 1 };
+    int64_t next_audio_pts_{ AV_NOPTS_VALUE };
+
+    std::atomic<bool> video_flushing_{false};
+    std::atomic<bool> audio_flushing_{false};
+    std::atomic<bool> error_{false};
+    std::thread video_thread_;
+    std::thread audio_thread_;
+    std::thread mux_thread_;
+
+    // encoder input: the filter threads push, the encode threads pop
+    RingVector<AVFrame*, 8> video_frame_buffer_{
+            []() { return av_frame_alloc(); },
+            [](AVFrame** frame) { av_frame_free(frame); }
+    };
+
+    RingVector<AVFrame*, 32> audio_frame_buffer_{
+            []() { return av_frame_alloc(); },
+            [](AVFrame** frame) { av_frame_free(frame); }
+    };
 
-    AVPacket * packet_{nullptr};
+    // muxer input: the encode threads push, the mux thread pops
+    std::mutex packet_mtx_;
+    RingVector<AVPacket*, 64> packet_buffer_{
+            []() { return av_packet_alloc(); },
+            [](AVPacket** packet) { av_packet_free(packet); }
+    };
 };
 
-#endif //!_05_ENCODER_H
\ No newline at end of file
+#endif //!_05_ENCODER_H
@@ -19,11 +19,14 @@ extern "C" {
 #include "defer.h"
 #include "logging.h"
 #include "ringvector.h"
+#include "filter_threading.h"
 #include "fmt/format.h"
 
+// a video (buffer -> buffersink) or an audio (abuffer -> abuffersink) graph
 class ComplexFilter {
 public:
-    ComplexFilter()
+    explicit ComplexFilter(AVMediaType type = AVMEDIA_TYPE_VIDEO)
+        : type_(type)
     {
         filter_graph_ = avfilter_graph_alloc();
     }
@@ -33,11 +36,18 @@ public:
         avfilter_graph_free(&filter_graph_);
     }
 
+    // before create_buffersrc()
+    void set_threading(const FilterThreading& threading)
+    {
+        CHECK(!filter_graph_->nb_filters) << "threading must be set before any filter is created";
+        threading.apply(filter_graph_);
+    }
+
     int create_buffersrc(const std::string& args)
     {
         LOG(INFO) << "create buffersrc for: " << args;
 
-        const AVFilter *buffersrc = avfilter_get_by_name("buffer");
+        const AVFilter *buffersrc = avfilter_get_by_name(type_ == AVMEDIA_TYPE_AUDIO ? "abuffer" : "buffer");
         CHECK_NOTNULL(buffersrc);
 
         AVFilterContext * filter_ctx = nullptr;
@@ -51,12 +61,19 @@ public:
     {
         LOG(INFO) << "create filter for: " << descr;
 
-        const AVFilter *buffersink = avfilter_get_by_name("buffersink");
+        const AVFilter *buffersink = avfilter_get_by_name(type_ == AVMEDIA_TYPE_AUDIO ? "abuffersink" : "buffersink");
         CHECK_NOTNULL(buffersink);
 
-        enum AVPixelFormat pix_fmts[] = { AV_PIX_FMT_YUV420P, AV_PIX_FMT_NONE };
         CHECK(avfilter_graph_create_filter(&buffersink_ctx_, buffersink, "sink", nullptr, nullptr, filter_graph_) >= 0);
-        CHECK(av_opt_set_int_list(buffersink_ctx_, "pix_fmts", pix_fmts, AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN) >= 0);
+        if (type_ == AVMEDIA_TYPE_AUDIO) {
+            // the aac encoder only takes planar float
+            enum AVSampleFormat sample_fmts[] = { AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_NONE };
+            CHECK(av_opt_set_int_list(buffersink_ctx_, "sample_fmts", sample_fmts, AV_SAMPLE_FMT_NONE, AV_OPT_SEARCH_CHILDREN) >= 0);
+        }
+        else {
+            enum AVPixelFormat pix_fmts[] = { AV_PIX_FMT_YUV420P, AV_PIX_FMT_NONE };
+            CHECK(av_opt_set_int_list(buffersink_ctx_, "pix_fmts", pix_fmts, AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN) >= 0);
+        }
 
         AVFilterInOut* inputs = nullptr;
         AVFilterInOut* outputs = nullptr;
@@ -84,6 +101,24 @@ public:
         return 0;
     }
 
+    // After avfilter_graph_request_oldest() returned EAGAIN: the input the graph is waiting for is the
+    // buffersrc with the most failed requests. Inputs that already got EOF are skipped; -1 if none is left.
+    int requested_input(const std::vector<bool>& input_eof) const
+    {
+        int idx = -1;
+        unsigned best = 0;
+        for (size_t i = 0; i < buffersrc_ctxs_.size(); i++) {
+            if (input_eof[i]) continue;
+
+            unsigned failed = av_buffersrc_get_nb_failed_requests(buffersrc_ctxs_[i]);
+            if (idx < 0 || failed > best) {
+                idx = static_cast<int>(i);
+                best = failed;
+            }
+        }
+        return idx;
+    }
+
     AVRational time_base() const { return av_buffersink_get_time_base(buffersink_ctx_); }
     AVRational sample_aspect_ratio() const { return av_buffersink_get_sample_aspect_ratio(buffersink_ctx_); }
     int height() const { return av_buffersink_get_h(buffersink_ctx_); }
@@ -91,9 +126,21 @@ public:
     AVRational framerate() const { return av_buffersink_get_frame_rate(buffersink_ctx_); }
     AVPixelFormat format() const { return (AVPixelFormat)av_buffersink_get_format(buffersink_ctx_); }
 
+    int sample_rate() const { return av_buffersink_get_sample_rate(buffersink_ctx_); }
+    uint64_t channel_layout() const { return av_buffersink_get_channel_layout(buffersink_ctx_); }
+    AVSampleFormat sample_format() const { return (AVSampleFormat)av_buffersink_get_format(buffersink_ctx_); }
+
+    // audio encoders with a fixed frame size need the sink to cut frames of exactly that many samples
+    void set_frame_size(int nb_samples)
+    {
+        if (nb_samples > 0) av_buffersink_set_frame_size(buffersink_ctx_, nb_samples);
+    }
+
     //private:
     std::atomic<bool> running_{false};
 
+    AVMediaType type_{ AVMEDIA_TYPE_VIDEO };
+
     AVFilterGraph * filter_graph_{nullptr};
     std::vector<AVFilterContext*> buffersrc_ctxs_{};
     AVFilterContext* buffersink_ctx_{ nullptr };
@@ -1,17 +1,107 @@
 #include "encoder.h"
 #include "decoder.h"
 #include "filter_graph.h"
+#include "watermark.h"
+
+// feed the graph exactly the input it is waiting for and pass everything it produces to @output.
+// @read_input(i, frame) pops the next frame of input i, false if none arrived in time
+static int64_t run_filter(ComplexFilter& filter,
+                          const std::function<bool(size_t, AVFrame *)>& read_input,
+                          const std::function<void(AVFrame *)>& output,
+                          int64_t& filter_us)
+{
+    const char * type = av_get_media_type_string(filter.type_);
+    LOG(INFO) << "[FILTER THREAD] " << type << " START @ " << std::this_thread::get_id();
+    AVFrame * frame = av_frame_alloc();
+    AVFrame * filtered_frame = av_frame_alloc();
+    defer(av_frame_free(&frame); av_frame_free(&filtered_frame));
+
+    std::vector<bool> input_eof(filter.buffersrc_ctxs_.size(), false);
+
+    // time spent inside the graph, waiting for the decoders excluded
+    int64_t filtered_frames = 0;
+
+    filter.running_ = true;
+    while(filter.running_) {
+        // ask the graph for its next output; on EAGAIN feed exactly the input it is waiting for
+        int64_t t0 = av_gettime_relative();
+        int ret = avfilter_graph_request_oldest(filter.filter_graph_);
+        filter_us += av_gettime_relative() - t0;
+        if (ret == AVERROR(EAGAIN)) {
+            int i = filter.requested_input(input_eof);
+            if (i < 0) {
+                LOG(ERROR) << "[FILTER THREAD] all inputs are closed, but the graph still needs frames";
+                break;
+            }
+
+            // block on that decoder only; the timeout is just to notice filter.running_
+            if (!read_input(i, frame)) {
+                continue;
+            }
+
+            input_eof[i] = !frame->width && !frame->height && !frame->nb_samples;
+            t0 = av_gettime_relative();
+            ret = av_buffersrc_add_frame_flags(filter.buffersrc_ctxs_[i], input_eof[i] ? nullptr : frame, AV_BUFFERSRC_FLAG_PUSH);
+            filter_us += av_gettime_relative() - t0;
+            if (ret < 0) {
+                LOG(ERROR) << "av_buffersrc_add_frame_flags()";
+                break;
+            }
+        }
+        else if (ret < 0 && ret != AVERROR_EOF) {
+            LOG(ERROR) << "avfilter_graph_request_oldest()";
+            break;
+        }
+
+        // drain what the graph has produced so far, without pulling on the inputs again
+        ret = 0;
+        while(ret >= 0) {
+            av_frame_unref(filtered_frame);
+            ret = av_buffersink_get_frame_flags(filter.buffersink_ctx_, filtered_frame, AV_BUFFERSINK_FLAG_NO_REQUEST);
+            if (ret == AVERROR(EAGAIN)) {
+                break;
+            }
+            else if (ret == AVERROR_EOF) {
+                LOG(INFO) << "[FILTER THREAD] " << type << " EOF";
+                av_frame_unref(filtered_frame);
+                filter.running_ = false;
+            }
+            else if (ret < 0) {
+                LOG(ERROR) << "av_buffersink_get_frame_flags()";
+                filter.running_ = false;
+                break;
+            }
+
+            if (ret >= 0) filtered_frames++;
+            output(filtered_frame);
+        }
+    }
+
+    return filtered_frames;
+}
 
 int main(int argc, char* argv[])
 {
     if (argc < 4) {
-        LOG(ERROR) << "complex_filter -i <input-watermark> -i <input-video> <output>";
+        LOG(ERROR) << "complex_filter -i <input-watermark> -i <input-video> [-filter_threads <n>] [-filter_pool] [-native_watermark] [-an] <output>";
         return -1;
     }
 
     std::vector<std::string> input_files;
     std::string output_file;
 
+    FilterThreading threading;
+    std::unique_ptr<ThreadPool> pool;
+
+    // blend the watermark (input 0) natively instead of "scale + overlay" in the graph
+    bool native_watermark = false;
+    WatermarkOverlay watermark;
+
+    // mix the audio of all inputs that have one, unless -an
+    bool with_audio = true;
+    std::vector<std::shared_ptr<Decoder>> audio_decoders;
+    ComplexFilter audio_filter(AVMEDIA_TYPE_AUDIO);
+
     std::vector<std::shared_ptr<Decoder>> decoders;
     std::vector<std::thread> threads;
     ComplexFilter filter;
@@ -22,6 +112,19 @@ int main(int argc, char* argv[])
             input_files.emplace_back(argv[i+1]);
             i++;
         }
+        else if (std::strcmp("-filter_threads", argv[i]) == 0 && i + 1 < argc) {
+            threading.nb_threads = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp("-filter_pool", argv[i]) == 0) {
+            pool = std::make_unique<ThreadPool>();
+            threading.pool = pool.get();
+        }
+        else if (std::strcmp("-native_watermark", argv[i]) == 0) {
+            native_watermark = true;
+        }
+        else if (std::strcmp("-an", argv[i]) == 0) {
+            with_audio = false;
+        }
         else if (output_file.empty()){
             output_file = argv[i];
         }
@@ -31,66 +134,113 @@ int main(int argc, char* argv[])
         }
     }
 
+    CHECK(input_files.size() >= 2) << "complex_filter -i <input-watermark> -i <input-video> <output>";
+    filter.set_threading(threading);
+
+    if (native_watermark) {
+        CHECK(watermark.open(input_files[0], 128, 10, 10) >= 0);
+    }
+
     // open input files
-    for(auto& input: input_files) {
+    for(size_t i = native_watermark ? 1 : 0; i < input_files.size(); i++) {
+        auto& input = input_files[i];
         auto decoder = std::make_shared<Decoder>();
-        CHECK(decoder->open(input) >= 0);
+        CHECK(decoder->open(input, with_audio) >= 0);
         decoders.push_back(decoder);
 
         filter.create_buffersrc(decoder->filter_args());
+        if (decoder->audio_stream_idx_ >= 0) {
+            audio_decoders.push_back(decoder);
+            audio_filter.create_buffersrc(decoder->audio_filter_args());
+        }
     }
+    with_audio = !audio_decoders.empty();
 
     // create filter graph
-    const std::string filter_complex = "[0:v] scale=128:-1:flags=lanczos [s];[1:v][s]overlay=10:10";
+    const std::string watermark_complex = "[0:v] scale=128:-1:flags=lanczos [s];[1:v][s]overlay=10:10";
+    const std::string filter_complex = native_watermark ? "null" : watermark_complex;
     filter.create(filter_complex);
-    LOG(INFO) << fmt::format(R"( -- same as : ffmpeg -i {} -i {} -filter_complex "{}" {})", input_files[0], input_files[1], filter_complex, output_file);
+    // the native watermark does the scale and overlay of the graph it replaces
+    LOG(INFO) << fmt::format(R"( -- same as : ffmpeg -i {} -i {} -filter_complex "{}" {})", input_files[0], input_files[1], watermark_complex, output_file);
+
+    // audio graph: [0:a][1:a]...amix
+    if (with_audio) {
+        std::string audio_filter_descr;
+        for (size_t i = 0; i < audio_decoders.size(); i++) {
+            audio_filter_descr += fmt::format("[{}:a]", i);
+        }
+        audio_filter_descr += audio_decoders.size() > 1 ? fmt::format("amix=inputs={}:duration=longest", audio_decoders.size()) : "anull";
+        audio_filter.create(audio_filter_descr);
+    }
 
     // open output file
-    encoder.open(output_file, filter.width(), filter.height(), filter.format(), filter.sample_aspect_ratio(), filter.framerate(), filter.time_base());
+    if (with_audio) {
+        encoder.open(output_file, filter.width(), filter.height(), filter.format(), filter.sample_aspect_ratio(), filter.framerate(), filter.time_base(),
+                     audio_filter.sample_rate(), audio_filter.channel_layout(), audio_filter.sample_format(), audio_filter.time_base());
+        audio_filter.set_frame_size(encoder.audio_frame_size());
+    }
+    else {
+        encoder.open(output_file, filter.width(), filter.height(), filter.format(), filter.sample_aspect_ratio(), filter.framerate(), filter.time_base());
+    }
 
     for (auto & decoder : decoders) {
         threads.emplace_back(std::thread([&](){ decoder->running_ = true; decoder->decode_thread(); }));
     }
 
-    LOG(INFO) << "[FILTER THREAD] START @ " << std::this_thread::get_id();
-    AVFrame * frame = av_frame_alloc();
-    AVFrame * filtered_frame = av_frame_alloc();
+    // the audio graph runs on its own thread, in parallel with the video one
+    std::thread audio_thread;
+    if (with_audio) {
+        audio_thread = std::thread([&]() {
+            int64_t audio_us = 0;
+            auto frames = run_filter(
+                    audio_filter,
+                    [&](size_t i, AVFrame * frame) {
+                        auto& buffer = audio_decoders[i]->audio_frame_buffer_;
+                        if (!buffer.wait_not_empty(std::chrono::milliseconds(100))) return false;
+                        buffer.pop([frame](AVFrame * popped) {
+                            av_frame_unref(frame);
+                            av_frame_move_ref(frame, popped);
+                        });
+                        return true;
+                    },
+                    [&](AVFrame * frame) { encoder.encode_audio_frame(frame); },
+                    audio_us);
+            LOG(INFO) << fmt::format("[FILTER THREAD] {} audio frames, {:.3f} ms in the audio graph", frames, audio_us / 1000.0);
+        });
+    }
 
-    filter.running_ = true;
-    while(filter.running_) {
-        for(size_t i = 0; i < decoders.size(); i++) {
-            if (decoders[i]->video_frame_buffer_.empty()) {
-                if (!decoders[i]->eof())
-                    av_usleep(20000);
-                continue;
-            }
+    int64_t filter_us = 0;
+    int64_t filtered_frames = run_filter(
+            filter,
+            [&](size_t i, AVFrame * frame) {
+                auto& buffer = decoders[i]->video_frame_buffer_;
+                if (!buffer.wait_not_empty(std::chrono::milliseconds(100))) return false;
+                buffer.pop([frame](AVFrame * popped) {
+                    av_frame_unref(frame);
+                    av_frame_move_ref(frame, popped);
+                });
+                return true;
+            },
+            [&](AVFrame * frame) {
+                if (native_watermark && frame->width) {
+                    int64_t t0 = av_gettime_relative();
+                    watermark.blend(frame);
+                    filter_us += av_gettime_relative() - t0;
+                }
+                encoder.encode_frame(frame);
+            },
+            filter_us);
 
-            decoders[i]->video_frame_buffer_.pop([&](AVFrame * popped) {
-                av_frame_unref(frame);
-                av_frame_move_ref(frame, popped);
-            });
+    LOG(INFO) << fmt::format("[FILTER THREAD] {} frames, {:.3f} ms/frame in the filter graph, threads = {}{}",
+                             filtered_frames, filtered_frames ? filter_us / 1000.0 / filtered_frames : 0.0,
+                             filter.filter_graph_->nb_threads, pool ? " (shared pool)" : "");
 
-            int ret = av_buffersrc_add_frame_flags(filter.buffersrc_ctxs_[i], (!frame->width && !frame->height) ? nullptr : frame, AV_BUFFERSRC_FLAG_PUSH);
-            while(ret >= 0) {
-                av_frame_unref(filtered_frame);
-                ret = av_buffersink_get_frame(filter.buffersink_ctx_, filtered_frame);
-                if (ret == AVERROR(EAGAIN)) {
-                    break;
-                }
-                else if (ret == AVERROR_EOF) {
-                    LOG(INFO) << "[FILTER THREAD] EOF";
-                    av_frame_unref(filtered_frame);
-                    filter.running_ = false;
-                }
-                else if (ret < 0) {
-                    LOG(ERROR) << "av_buffersink_get_frame_flags()";
-                    filter.running_ = false;
-                    break;
-                }
+    if (audio_thread.joinable()) {
+        audio_thread.join();
+    }
 
-                encoder.encode_frame(filtered_frame);
-            }
-        }
+    for (auto& decoder : decoders) {
+        decoder->running_ = false;
     }
 
     for (auto& thread : threads) {
@@ -99,10 +249,8 @@ int main(int argc, char* argv[])
         }
     }
 
-    LOG(INFO) << "EXITED";
-
-    av_frame_free(&filtered_frame);
-    av_frame_free(&frame);
+    encoder.close();
 
+    LOG(INFO) << "EXITED";
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,252 @@
+#ifndef _05_WATERMARK_H
+#define _05_WATERMARK_H
+
+#include <vector>
+#include <string>
+#include <map>
+#include <cmath>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define WATERMARK_SSE2 1
+#endif
+
+#include "defer.h"
+#include "logging.h"
+#include "fmt/format.h"
+
+// Same result as "[0:v] scale=<w>:-1:flags=lanczos [s];[1:v][s]overlay=<x>:<y>" for a still image, but the
+// watermark is decoded, scaled and premultiplied once, then blended into each frame in place:
+//   dst = color * a + dst * (255 - a)      (color * a precomputed per plane)
+class WatermarkOverlay {
+public:
+    WatermarkOverlay() = default;
+    WatermarkOverlay(const WatermarkOverlay&) = delete;
+    WatermarkOverlay& operator=(const WatermarkOverlay&) = delete;
+
+    ~WatermarkOverlay()
+    {
+        av_frame_free(&rgba_);
+    }
+
+    // width > 0: scale to this width, keeping the aspect ratio; otherwise keep the image size
+    int open(const std::string& filename, int width, int x, int y)
+    {
+        x_ = x & ~1;
+        y_ = y & ~1;
+
+        AVFrame * decoded = decode_first_frame(filename);
+        CHECK_NOTNULL(decoded);
+        defer(av_frame_free(&decoded));
+
+        const int w = width > 0 ? width : decoded->width;
+        const int h = std::max(1, (int)std::lround((double)decoded->height * w / decoded->width));
+
+        rgba_ = av_frame_alloc();
+        rgba_->format = AV_PIX_FMT_RGBA;
+        rgba_->width = w;
+        rgba_->height = h;
+        CHECK(av_frame_get_buffer(rgba_, 0) >= 0);
+
+        auto sws_ctx = sws_getContext(decoded->width, decoded->height, (AVPixelFormat)decoded->format,
+                                      w, h, AV_PIX_FMT_RGBA, SWS_LANCZOS, nullptr, nullptr, nullptr);
+        CHECK_NOTNULL(sws_ctx);
+        defer(sws_freeContext(sws_ctx));
+        sws_scale(sws_ctx, decoded->data, decoded->linesize, 0, decoded->height, rgba_->data, rgba_->linesize);
+
+        LOG(INFO) << fmt::format("[WATERMARK] {}: {}x{} -> {}x{} @ ({}, {})", filename, decoded->width, decoded->height, w, h, x_, y_);
+        return 0;
+    }
+
+    // frame must be 8-bit planar YUV or GRAY; it is made writable if needed
+    int blend(AVFrame * frame)
+    {
+        auto it = cache_.find(frame->format);
+        if (it == cache_.end()) {
+            it = cache_.emplace(frame->format, prepare((AVPixelFormat)frame->format)).first;
+        }
+        const Prepared& prepared = it->second;
+        if (prepared.planes.empty()) return -1;
+
+        if (av_frame_make_writable(frame) < 0) return -1;
+
+        for (size_t i = 0; i < prepared.planes.size(); i++) {
+            const Plane& p = prepared.planes[i];
+            const int x = x_ >> p.shift_w;
+            const int y = y_ >> p.shift_h;
+            const int fw = AV_CEIL_RSHIFT(frame->width, p.shift_w);
+            const int fh = AV_CEIL_RSHIFT(frame->height, p.shift_h);
+            const int w = std::min(p.w, fw - x);
+            const int h = std::min(p.h, fh - y);
+            if (w <= 0 || h <= 0) continue;
+
+            for (int j = 0; j < h; j++) {
+                blend_row(frame->data[i] + (y + j) * frame->linesize[i] + x,
+                          p.color.data() + j * p.w, p.inv_alpha.data() + j * p.w, w);
+            }
+        }
+        return 0;
+    }
+
+    int width() const { return rgba_ ? rgba_->width : 0; }
+    int height() const { return rgba_ ? rgba_->height : 0; }
+
+    // dst = color + dst * inv_alpha / 255, with color already multiplied by alpha
+    static void blend_row(uint8_t * dst, const uint8_t * color, const uint8_t * inv_alpha, int n)
+    {
+        int i = 0;
+#ifdef WATERMARK_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi16(128);
+        for (; i + 16 <= n; i += 16) {
+            __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+            __m128i ia = _mm_loadu_si128((const __m128i *)(inv_alpha + i));
+            __m128i c = _mm_loadu_si128((const __m128i *)(color + i));
+
+            __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(ia, zero)), round);
+            __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(ia, zero)), round);
+            // x / 255 == (x + (x >> 8)) >> 8 for x = v * a + 128
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_adds_epu8(_mm_packus_epi16(lo, hi), c));
+        }
+#endif
+        for (; i < n; i++) {
+            int t = dst[i] * inv_alpha[i] + 128;
+            t = (t + (t >> 8)) >> 8;
+            dst[i] = (uint8_t)std::min(255, t + color[i]);
+        }
+    }
+
+private:
+    struct Plane {
+        int w{ 0 };
+        int h{ 0 };
+        int shift_w{ 0 };
+        int shift_h{ 0 };
+        std::vector<uint8_t> color{};       // premultiplied
+        std::vector<uint8_t> inv_alpha{};   // 255 - alpha
+    };
+
+    struct Prepared {
+        std::vector<Plane> planes{};        // empty: unsupported format
+    };
+
+    Prepared prepare(AVPixelFormat format) const
+    {
+        Prepared prepared;
+
+        const AVPixFmtDescriptor * desc = av_pix_fmt_desc_get(format);
+        const bool gray = desc && desc->nb_components == 1;
+        if (!desc || !(desc->flags & AV_PIX_FMT_FLAG_PLANAR || gray) || (desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_ALPHA)) ||
+            desc->comp[0].depth != 8 || (desc->nb_components != 3 && !gray)) {
+            LOG(WARNING) << "[WATERMARK] unsupported pixel format: " << av_get_pix_fmt_name(format);
+            return prepared;
+        }
+
+        const int w = rgba_->width;
+        const int h = rgba_->height;
+
+        // the color in the target format, converted once
+        uint8_t * data[4] = {};
+        int linesize[4] = {};
+        CHECK(av_image_alloc(data, linesize, w, h, format, 1) >= 0);
+        defer(av_freep(&data[0]));
+
+        auto sws_ctx = sws_getContext(w, h, AV_PIX_FMT_RGBA, w, h, format, SWS_LANCZOS, nullptr, nullptr, nullptr);
+        CHECK_NOTNULL(sws_ctx);
+        defer(sws_freeContext(sws_ctx));
+        sws_scale(sws_ctx, rgba_->data, rgba_->linesize, 0, h, data, linesize);
+
+        for (int i = 0; i < desc->nb_components; i++) {
+            Plane p;
+            p.shift_w = (i == 0) ? 0 : desc->log2_chroma_w;
+            p.shift_h = (i == 0) ? 0 : desc->log2_chroma_h;
+            p.w = AV_CEIL_RSHIFT(w, p.shift_w);
+            p.h = AV_CEIL_RSHIFT(h, p.shift_h);
+            p.color.resize(p.w * p.h);
+            p.inv_alpha.resize(p.w * p.h);
+
+            for (int j = 0; j < p.h; j++) {
+                for (int k = 0; k < p.w; k++) {
+                    // alpha of a subsampled plane: average over the covered pixels
+                    int sum = 0, count = 0;
+                    for (int yy = j << p.shift_h; yy < std::min(h, (j + 1) << p.shift_h); yy++) {
+                        for (int xx = k << p.shift_w; xx < std::min(w, (k + 1) << p.shift_w); xx++) {
+                            sum += rgba_->data[0][yy * rgba_->linesize[0] + xx * 4 + 3];
+                            count++;
+                        }
+                    }
+                    const int a = (sum + count / 2) / count;
+                    const int c = data[i][j * linesize[i] + k];
+                    p.color[j * p.w + k] = (uint8_t)((c * a + 127) / 255);
+                    p.inv_alpha[j * p.w + k] = (uint8_t)(255 - a);
+                }
+            }
+            prepared.planes.push_back(std::move(p));
+        }
+
+        LOG(INFO) << "[WATERMARK] prepared for " << av_get_pix_fmt_name(format);
+        return prepared;
+    }
+
+    static AVFrame * decode_first_frame(const std::string& filename)
+    {
+        AVFormatContext * fmt_ctx = nullptr;
+        CHECK(avformat_open_input(&fmt_ctx, filename.c_str(), nullptr, nullptr) >= 0);
+        defer(avformat_close_input(&fmt_ctx));
+        CHECK(avformat_find_stream_info(fmt_ctx, nullptr) >= 0);
+
+        int idx = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        CHECK(idx >= 0);
+
+        auto decoder = avcodec_find_decoder(fmt_ctx->streams[idx]->codecpar->codec_id);
+        CHECK_NOTNULL(decoder);
+        AVCodecContext * decode_ctx = avcodec_alloc_context3(decoder);
+        CHECK_NOTNULL(decode_ctx);
+        defer(avcodec_free_context(&decode_ctx));
+        CHECK(avcodec_parameters_to_context(decode_ctx, fmt_ctx->streams[idx]->codecpar) >= 0);
+        CHECK(avcodec_open2(decode_ctx, decoder, nullptr) >= 0);
+
+        AVPacket * packet = av_packet_alloc();
+        defer(av_packet_free(&packet));
+        AVFrame * frame = av_frame_alloc();
+
+        // a still image has one frame, which may only come out when the decoder is flushed
+        bool flushed = false;
+        while (!flushed) {
+            int ret = av_read_frame(fmt_ctx, packet);
+            if (ret < 0) {
+                flushed = true;
+                avcodec_send_packet(decode_ctx, nullptr);
+            }
+            else if (packet->stream_index == idx) {
+                avcodec_send_packet(decode_ctx, packet);
+            }
+            av_packet_unref(packet);
+
+            if (avcodec_receive_frame(decode_ctx, frame) == 0) {
+                return frame;
+            }
+        }
+
+        av_frame_free(&frame);
+        return nullptr;
+    }
+
+    int x_{ 0 };
+    int y_{ 0 };
+    AVFrame * rgba_{ nullptr };
+    std::map<int, Prepared> cache_{};
+};
+
+#endif //!_05_WATERMARK_H
@@ -0,0 +1,342 @@
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <future>
+#include "decoder.h"
+#include "palette.h"
+#include "spool.h"
+#include "threadpool.h"
+
+extern "C" {
+#include <libswscale/swscale.h>
+#include <libavutil/imgutils.h>
+}
+
+// pal8 frames -> gif encoder -> gif muxer, timestamps in 1/100 s (the gif delay unit)
+class GifWriter {
+public:
+    GifWriter()
+    {
+        packet_ = av_packet_alloc();
+    }
+    GifWriter(const GifWriter&) = delete;
+    GifWriter& operator=(const GifWriter&) = delete;
+
+    ~GifWriter()
+    {
+        close();
+        avcodec_free_context(&encode_ctx_);
+        av_packet_free(&packet_);
+    }
+
+    int open(const std::string& filename, int w, int h)
+    {
+        CHECK(avformat_alloc_output_context2(&fmt_ctx_, nullptr, "gif", filename.c_str()) >= 0);
+        CHECK_NOTNULL(avformat_new_stream(fmt_ctx_, nullptr));
+
+        auto encoder = avcodec_find_encoder(AV_CODEC_ID_GIF);
+        CHECK_NOTNULL(encoder);
+        encode_ctx_ = avcodec_alloc_context3(encoder);
+        CHECK_NOTNULL(encode_ctx_);
+
+        encode_ctx_->width = w;
+        encode_ctx_->height = h;
+        encode_ctx_->pix_fmt = AV_PIX_FMT_PAL8;
+        encode_ctx_->time_base = { 1, 100 };
+        fmt_ctx_->streams[0]->time_base = encode_ctx_->time_base;
+
+        CHECK(avcodec_open2(encode_ctx_, encoder, nullptr) >= 0);
+        CHECK(avcodec_parameters_from_context(fmt_ctx_->streams[0]->codecpar, encode_ctx_) >= 0);
+
+        if(!(fmt_ctx_->oformat->flags & AVFMT_NOFILE)) {
+            CHECK(avio_open(&fmt_ctx_->pb, filename.c_str(), AVIO_FLAG_WRITE) >= 0);
+        }
+        CHECK(avformat_write_header(fmt_ctx_, nullptr) >= 0);
+
+        av_dump_format(fmt_ctx_, 0, filename.c_str(), 1);
+        return 0;
+    }
+
+    // nullptr flushes the encoder
+    int write(AVFrame * frame)
+    {
+        int ret = avcodec_send_frame(encode_ctx_, frame);
+        while (ret >= 0) {
+            av_packet_unref(packet_);
+            ret = avcodec_receive_packet(encode_ctx_, packet_);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                return 0;
+            }
+            else if (ret < 0) {
+                LOG(ERROR) << "avcodec_receive_packet()";
+                return -1;
+            }
+
+            packet_->stream_index = 0;
+            av_packet_rescale_ts(packet_, encode_ctx_->time_base, fmt_ctx_->streams[0]->time_base);
+            if (av_interleaved_write_frame(fmt_ctx_, packet_) != 0) {
+                LOG(ERROR) << "av_interleaved_write_frame()";
+                return -1;
+            }
+        }
+        return ret == AVERROR(EAGAIN) ? 0 : ret;
+    }
+
+    int close()
+    {
+        if (!fmt_ctx_) return 0;
+
+        write(nullptr);
+        int ret = av_write_trailer(fmt_ctx_);
+        if (!(fmt_ctx_->oformat->flags & AVFMT_NOFILE))
+            avio_closep(&fmt_ctx_->pb);
+
+        avformat_free_context(fmt_ctx_);
+        fmt_ctx_ = nullptr;
+        return ret;
+    }
+
+//private:
+    AVFormatContext * fmt_ctx_{nullptr};
+    AVCodecContext * encode_ctx_{nullptr};
+    AVPacket * packet_{nullptr};
+};
+
+enum class StatsMode { FULL, DIFF };
+
+// a run of consecutive spooled frames, dithered as a unit on one pool thread
+struct Segment {
+    size_t begin{ 0 };
+    size_t end{ 0 };
+    std::shared_ptr<Palette> palette;
+    std::vector<uint8_t> indices;       // (end - begin) frames of w * h palette indices
+};
+
+// colours of frames [begin, end); in diff mode only the pixels that changed since the previous frame count
+static void count_colors(const FrameSpool& spool, size_t begin, size_t end, int w, int h, StatsMode mode, ColorHistogram& histogram)
+{
+    for (size_t i = begin; i < end; i++) {
+        if (mode == StatsMode::DIFF && i > begin) {
+            histogram.add_diff(spool.frame(i), spool.frame(i - 1), w * 3, w, h);
+        }
+        else {
+            histogram.add(spool.frame(i), w * 3, w, h);
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const char * usage = "gen_gif -i <input> [-r <fps>] [-w <width>] [-max_colors <n>] [-dither floyd_steinberg|none] "
+                         "[-stats_mode full|diff] [-segment <seconds>] [-threads <n>] <output.gif>";
+    if (argc < 4) {
+        LOG(ERROR) << usage;
+        return -1;
+    }
+
+    std::string input_file;
+    std::string output_file;
+    double fps = 10;
+    int width = 480;
+    int max_colors = 256;
+    Dither dither = Dither::FLOYD_STEINBERG;
+    StatsMode stats_mode = StatsMode::FULL;
+    double segment_s = 2.0;
+    int nb_threads = 0;
+
+    for (int i = 1; i < argc; i++){
+        if (std::strcmp("-i", argv[i]) == 0 && i + 1 < argc) {
+            input_file = argv[++i];
+        }
+        else if (std::strcmp("-r", argv[i]) == 0 && i + 1 < argc) {
+            fps = std::atof(argv[++i]);
+        }
+        else if (std::strcmp("-w", argv[i]) == 0 && i + 1 < argc) {
+            width = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp("-max_colors", argv[i]) == 0 && i + 1 < argc) {
+            max_colors = std::clamp(std::atoi(argv[++i]), 2, 256);
+        }
+        else if (std::strcmp("-dither", argv[i]) == 0 && i + 1 < argc) {
+            dither = std::strcmp("none", argv[++i]) == 0 ? Dither::NONE : Dither::FLOYD_STEINBERG;
+        }
+        else if (std::strcmp("-stats_mode", argv[i]) == 0 && i + 1 < argc) {
+            stats_mode = std::strcmp("diff", argv[++i]) == 0 ? StatsMode::DIFF : StatsMode::FULL;
+        }
+        else if (std::strcmp("-segment", argv[i]) == 0 && i + 1 < argc) {
+            segment_s = std::atof(argv[++i]);
+        }
+        else if (std::strcmp("-threads", argv[i]) == 0 && i + 1 < argc) {
+            nb_threads = std::atoi(argv[++i]);
+        }
+        else if (output_file.empty()){
+            output_file = argv[i];
+        }
+        else {
+            LOG(ERROR) << usage;
+            return -1;
+        }
+    }
+    CHECK(!input_file.empty() && !output_file.empty() && fps > 0) << usage;
+
+    Decoder decoder;
+    CHECK(decoder.open(input_file) >= 0);
+    CHECK(decoder.video_stream_idx_ >= 0) << "no video stream in " << input_file;
+
+    // output size: -w <= 0 keeps the input width, the height follows the display aspect ratio
+    const auto video_stream = decoder.fmt_ctx_->streams[decoder.video_stream_idx_];
+    const AVRational sar = video_stream->sample_aspect_ratio.num ? video_stream->sample_aspect_ratio : AVRational{ 1, 1 };
+    const int src_w = decoder.video_decode_ctx_->width;
+    const int src_h = decoder.video_decode_ctx_->height;
+    const int w = width > 0 ? width : src_w;
+    const int h = std::max(static_cast<int>(std::lround(double(w) * src_h / (src_w * av_q2d(sar)))), 1);
+    const AVRational time_base = video_stream->time_base;
+
+    LOG(INFO) << fmt::format("[GIF] {}x{} -> {}x{} @ {} fps, {} colors, dither = {}, stats_mode = {}",
+                             src_w, src_h, w, h, fps, max_colors, dither == Dither::NONE ? "none" : "floyd_steinberg",
+                             stats_mode == StatsMode::DIFF ? "diff" : "full");
+
+    std::thread decode_thread([&]() { decoder.running_ = true; decoder.decode_thread(); });
+
+    // pass 1: decode and scale once, keep one frame per output tick and spool it
+    FrameSpool spool;
+    CHECK(spool.open(static_cast<size_t>(w) * h * 3) >= 0);
+
+    std::vector<int64_t> pts;           // 1/100 s
+    std::vector<uint8_t> rgb(static_cast<size_t>(w) * h * 3);
+    uint8_t * rgb_data[4] = { rgb.data(), nullptr, nullptr, nullptr };
+    int rgb_linesize[4] = { w * 3, 0, 0, 0 };
+
+    SwsContext * sws_ctx = nullptr;
+    AVFrame * frame = av_frame_alloc();
+    int64_t first_pts = AV_NOPTS_VALUE;
+    int64_t next_tick = 0;
+    int64_t t0 = av_gettime_relative();
+
+    while (true) {
+        if (!decoder.video_frame_buffer_.wait_not_empty(std::chrono::milliseconds(100))) {
+            continue;
+        }
+        decoder.video_frame_buffer_.pop([frame](AVFrame * popped) {
+            av_frame_unref(frame);
+            av_frame_move_ref(frame, popped);
+        });
+        if (!frame->width && !frame->height) break;
+
+        if (first_pts == AV_NOPTS_VALUE) first_pts = frame->best_effort_timestamp;
+        const double t = (frame->best_effort_timestamp - first_pts) * av_q2d(time_base);
+
+        // drop frames until the next output tick
+        const int64_t tick = std::llround(t * fps);
+        if (tick < next_tick) continue;
+        next_tick = tick + 1;
+
+        sws_ctx = sws_getCachedContext(sws_ctx,
+                                       frame->width, frame->height, static_cast<AVPixelFormat>(frame->format),
+                                       w, h, AV_PIX_FMT_RGB24, SWS_LANCZOS, nullptr, nullptr, nullptr);
+        CHECK_NOTNULL(sws_ctx);
+        sws_scale(sws_ctx, frame->data, frame->linesize, 0, frame->height, rgb_data, rgb_linesize);
+
+        CHECK(spool.append(rgb.data()) >= 0);
+
+        // strictly increasing, the muxer derives the delays from them
+        const int64_t cs = std::lround(t * 100);
+        pts.push_back(pts.empty() ? cs : std::max(cs, pts.back() + 1));
+    }
+    decode_thread.join();
+    sws_freeContext(sws_ctx);
+    av_frame_free(&frame);
+
+    const int64_t t1 = av_gettime_relative();
+    LOG(INFO) << fmt::format("[GIF] pass 1: {} frames spooled in {:.3f} s", spool.size(), (t1 - t0) / 1e6);
+    CHECK(spool.size() > 0) << "no frames decoded";
+
+    // pass 2: colour statistics, palettes and dithering run on the pool, segment by segment;
+    // the encoder takes the segments back in order
+    CHECK(spool.map() >= 0);
+    ThreadPool pool(nb_threads > 0 ? nb_threads : std::thread::hardware_concurrency());
+
+    const size_t nb_frames = spool.size();
+    const size_t segment_frames = std::max<size_t>(std::llround(segment_s * fps), 1);
+    const size_t nb_segments = (nb_frames + segment_frames - 1) / segment_frames;
+
+    // full: one palette for the whole clip, from histograms of one contiguous range per thread, merged
+    std::shared_ptr<Palette> global_palette;
+    if (stats_mode == StatsMode::FULL) {
+        const int nb_ranges = static_cast<int>(std::min(nb_frames, pool.size() + 1));
+        std::vector<ColorHistogram> histograms(nb_ranges);
+        pool.parallel_for(nb_ranges, [&](int r) {
+            count_colors(spool, nb_frames * r / nb_ranges, nb_frames * (r + 1) / nb_ranges, w, h, stats_mode, histograms[r]);
+        });
+        for (int r = 1; r < nb_ranges; r++) {
+            histograms[0].merge(histograms[r]);
+        }
+        global_palette = median_cut(histograms[0], max_colors);
+    }
+
+    // diff: every segment gets its own palette from the pixels that change within it
+    auto process = [&](size_t s) {
+        auto segment = std::make_shared<Segment>();
+        segment->begin = s * segment_frames;
+        segment->end = std::min(segment->begin + segment_frames, nb_frames);
+
+        segment->palette = global_palette;
+        if (!segment->palette) {
+            ColorHistogram histogram;
+            count_colors(spool, segment->begin, segment->end, w, h, stats_mode, histogram);
+            segment->palette = median_cut(histogram, max_colors);
+        }
+
+        const size_t frame_size = static_cast<size_t>(w) * h;
+        segment->indices.resize((segment->end - segment->begin) * frame_size);
+        for (size_t i = segment->begin; i < segment->end; i++) {
+            dither_frame(spool.frame(i), w * 3, w, h, *segment->palette, dither,
+                         segment->indices.data() + (i - segment->begin) * frame_size, w);
+        }
+        return segment;
+    };
+
+    GifWriter writer;
+    writer.open(output_file, w, h);
+
+    AVFrame * pal8 = av_frame_alloc();
+    pal8->format = AV_PIX_FMT_PAL8;
+    pal8->width = w;
+    pal8->height = h;
+    CHECK(av_frame_get_buffer(pal8, 0) >= 0);
+
+    // a bounded window of segments in flight keeps the dithered output from piling up
+    const size_t window = 2 * pool.size() + 1;
+    std::deque<std::future<std::shared_ptr<Segment>>> pending;
+    size_t submitted = 0;
+    size_t nb_palettes = 0;
+
+    for (size_t s = 0; s < nb_segments; s++) {
+        while (submitted < nb_segments && submitted < s + window) {
+            pending.push_back(pool.submit([&process, submitted]() { return process(submitted); }));
+            submitted++;
+        }
+
+        auto segment = pending.front().get();
+        pending.pop_front();
+        nb_palettes += !global_palette;
+
+        for (size_t i = segment->begin; i < segment->end; i++) {
+            CHECK(av_frame_make_writable(pal8) >= 0);
+
+            std::memset(pal8->data[1], 0, AVPALETTE_SIZE);
+            std::memcpy(pal8->data[1], segment->palette->colors().data(), segment->palette->colors().size() * sizeof(uint32_t));
+
+            av_image_copy_plane(pal8->data[0], pal8->linesize[0],
+                                segment->indices.data() + (i - segment->begin) * w * h, w, w, h);
+            pal8->pts = pts[i];
+            CHECK(writer.write(pal8) >= 0);
+        }
+    }
+    CHECK(writer.close() >= 0);
+    av_frame_free(&pal8);
+
+    LOG(INFO) << fmt::format("[GIF] pass 2: {} segments, {} palettes, {} frames encoded in {:.3f} s, threads = {}",
+                             nb_segments, global_palette ? 1 : nb_palettes, nb_frames, (av_gettime_relative() - t1) / 1e6, pool.size());
+    return 0;
+}
@@ -0,0 +1,238 @@
+#ifndef _06_PALETTE_H
+#define _06_PALETTE_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+
+// colours are counted and looked up with 6 bits per channel, 2^18 bins
+constexpr int HIST_BITS = 6;
+constexpr int HIST_SIZE = 1 << (3 * HIST_BITS);
+
+static inline int color_bin(int r, int g, int b)
+{
+    constexpr int shift = 8 - HIST_BITS;
+    return ((r >> shift) << (2 * HIST_BITS)) | ((g >> shift) << HIST_BITS) | (b >> shift);
+}
+
+struct ColorHistogram {
+    std::vector<uint64_t> bins = std::vector<uint64_t>(HIST_SIZE, 0);
+
+    // packed rgb24
+    void add(const uint8_t * rgb, int linesize, int width, int height)
+    {
+        for (int y = 0; y < height; y++) {
+            const uint8_t * p = rgb + y * linesize;
+            for (int x = 0; x < width; x++, p += 3) {
+                bins[color_bin(p[0], p[1], p[2])]++;
+            }
+        }
+    }
+
+    // only the pixels that differ from @prev
+    void add_diff(const uint8_t * rgb, const uint8_t * prev, int linesize, int width, int height)
+    {
+        for (int y = 0; y < height; y++) {
+            const uint8_t * p = rgb + y * linesize;
+            const uint8_t * q = prev + y * linesize;
+            for (int x = 0; x < width; x++, p += 3, q += 3) {
+                if (p[0] != q[0] || p[1] != q[1] || p[2] != q[2]) bins[color_bin(p[0], p[1], p[2])]++;
+            }
+        }
+    }
+
+    void merge(const ColorHistogram& other)
+    {
+        for (int i = 0; i < HIST_SIZE; i++) bins[i] += other.bins[i];
+    }
+
+    void clear() { std::fill(bins.begin(), bins.end(), 0); }
+};
+
+class Palette {
+public:
+    Palette() : lut_(new std::atomic<int16_t>[HIST_SIZE])
+    {
+        for (int i = 0; i < HIST_SIZE; i++) lut_[i].store(-1, std::memory_order_relaxed);
+    }
+
+    // 0xAARRGGBB, as the palette plane of AV_PIX_FMT_PAL8 expects
+    const std::vector<uint32_t>& colors() const { return colors_; }
+
+    void add(int r, int g, int b) { colors_.push_back(0xff000000u | (r << 16) | (g << 8) | b); }
+
+    // the palette entry nearest to the centre of the bin of (r, g, b), cached per bin. The cached value only
+    // depends on the bin, so threads filling the cache concurrently store the same index
+    int index_of(int r, int g, int b) const
+    {
+        const int bin = color_bin(r, g, b);
+        int idx = lut_[bin].load(std::memory_order_relaxed);
+        if (idx < 0) {
+            constexpr int shift = 8 - HIST_BITS;
+            constexpr int half = 1 << (shift - 1);
+            idx = nearest(((r >> shift) << shift) | half, ((g >> shift) << shift) | half, ((b >> shift) << shift) | half);
+            lut_[bin].store(static_cast<int16_t>(idx), std::memory_order_relaxed);
+        }
+        return idx;
+    }
+
+private:
+    int nearest(int r, int g, int b) const
+    {
+        int best = 0;
+        int best_dist = INT32_MAX;
+        for (size_t i = 0; i < colors_.size(); i++) {
+            const int dr = static_cast<int>((colors_[i] >> 16) & 0xff) - r;
+            const int dg = static_cast<int>((colors_[i] >> 8) & 0xff) - g;
+            const int db = static_cast<int>(colors_[i] & 0xff) - b;
+            const int dist = dr * dr + dg * dg + db * db;
+            if (dist < best_dist) {
+                best = static_cast<int>(i);
+                best_dist = dist;
+            }
+        }
+        return best;
+    }
+
+    std::vector<uint32_t> colors_;
+    std::unique_ptr<std::atomic<int16_t>[]> lut_;
+};
+
+// median cut: keep splitting the box with the largest weighted variance along its longest axis at the weighted median
+static inline std::shared_ptr<Palette> median_cut(const ColorHistogram& hist, int max_colors)
+{
+    struct Entry { uint8_t c[3]; uint64_t count; };
+    struct Box { size_t begin, end; int axis; double score; };
+
+    std::vector<Entry> entries;
+    constexpr int shift = 8 - HIST_BITS;
+    constexpr int mask = (1 << HIST_BITS) - 1;
+    for (int i = 0; i < HIST_SIZE; i++) {
+        if (!hist.bins[i]) continue;
+        entries.push_back({{
+            static_cast<uint8_t>((((i >> (2 * HIST_BITS)) & mask) << shift) | (1 << (shift - 1))),
+            static_cast<uint8_t>((((i >> HIST_BITS) & mask) << shift) | (1 << (shift - 1))),
+            static_cast<uint8_t>(((i & mask) << shift) | (1 << (shift - 1)))
+        }, hist.bins[i]});
+    }
+
+    auto measure = [&](Box& box) {
+        uint8_t lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+        double sum[3] = {}, sum2[3] = {}, total = 0;
+        for (size_t i = box.begin; i < box.end; i++) {
+            const auto& e = entries[i];
+            for (int k = 0; k < 3; k++) {
+                lo[k] = std::min(lo[k], e.c[k]);
+                hi[k] = std::max(hi[k], e.c[k]);
+                sum[k] += double(e.c[k]) * e.count;
+                sum2[k] += double(e.c[k]) * e.c[k] * e.count;
+            }
+            total += e.count;
+        }
+        box.axis = 0;
+        for (int k = 1; k < 3; k++) {
+            if (hi[k] - lo[k] > hi[box.axis] - lo[box.axis]) box.axis = k;
+        }
+        // sum of squared errors along the axis, 0 for a single colour
+        const int a = box.axis;
+        box.score = box.end - box.begin > 1 ? sum2[a] - sum[a] * sum[a] / total : 0;
+    };
+
+    std::vector<Box> boxes;
+    if (!entries.empty()) {
+        boxes.push_back({ 0, entries.size(), 0, 0 });
+        measure(boxes.back());
+    }
+
+    while (static_cast<int>(boxes.size()) < max_colors) {
+        auto it = std::max_element(boxes.begin(), boxes.end(), [](const Box& l, const Box& r) { return l.score < r.score; });
+        if (it == boxes.end() || it->score <= 0) break;
+
+        Box box = *it;
+        const int a = box.axis;
+        std::sort(entries.begin() + box.begin, entries.begin() + box.end,
+                  [a](const Entry& l, const Entry& r) { return l.c[a] < r.c[a]; });
+
+        uint64_t total = 0;
+        for (size_t i = box.begin; i < box.end; i++) total += entries[i].count;
+
+        // first entry past the weighted median, both halves non-empty
+        size_t split = box.begin + 1;
+        for (uint64_t acc = entries[box.begin].count; split < box.end - 1 && acc * 2 < total; split++) {
+            acc += entries[split].count;
+        }
+
+        Box left{ box.begin, split, 0, 0 }, right{ split, box.end, 0, 0 };
+        measure(left);
+        measure(right);
+        *it = left;
+        boxes.push_back(right);
+    }
+
+    auto palette = std::make_shared<Palette>();
+    for (const auto& box : boxes) {
+        double sum[3] = {}, total = 0;
+        for (size_t i = box.begin; i < box.end; i++) {
+            for (int k = 0; k < 3; k++) sum[k] += double(entries[i].c[k]) * entries[i].count;
+            total += entries[i].count;
+        }
+        palette->add(static_cast<int>(sum[0] / total + 0.5), static_cast<int>(sum[1] / total + 0.5), static_cast<int>(sum[2] / total + 0.5));
+    }
+    if (palette->colors().empty()) palette->add(0, 0, 0);
+    return palette;
+}
+
+enum class Dither { NONE, FLOYD_STEINBERG };
+
+// packed rgb24 -> palette indices
+static inline void dither_frame(const uint8_t * rgb, int linesize, int width, int height, const Palette& palette, Dither mode,
+                                uint8_t * out, int out_linesize)
+{
+    if (mode == Dither::NONE) {
+        for (int y = 0; y < height; y++) {
+            const uint8_t * p = rgb + y * linesize;
+            uint8_t * o = out + y * out_linesize;
+            for (int x = 0; x < width; x++, p += 3) {
+                o[x] = static_cast<uint8_t>(palette.index_of(p[0], p[1], p[2]));
+            }
+        }
+        return;
+    }
+
+    // error of the current and the next row, one pixel of padding on each side
+    std::vector<int> errors(2 * 3 * (width + 2), 0);
+    int * cur = errors.data();
+    int * next = errors.data() + 3 * (width + 2);
+    const auto& colors = palette.colors();
+
+    for (int y = 0; y < height; y++) {
+        const uint8_t * p = rgb + y * linesize;
+        uint8_t * o = out + y * out_linesize;
+        std::fill(next, next + 3 * (width + 2), 0);
+
+        for (int x = 0; x < width; x++, p += 3) {
+            int * e = cur + 3 * (x + 1);
+            int c[3];
+            for (int k = 0; k < 3; k++) c[k] = std::clamp(p[k] + (e[k] + 8) / 16, 0, 255);
+
+            const int idx = palette.index_of(c[0], c[1], c[2]);
+            o[x] = static_cast<uint8_t>(idx);
+
+            const int q[3] = { int((colors[idx] >> 16) & 0xff), int((colors[idx] >> 8) & 0xff), int(colors[idx] & 0xff) };
+            int * n = next + 3 * (x + 1);
+            for (int k = 0; k < 3; k++) {
+                const int err = c[k] - q[k];
+                e[k + 3] += err * 7;
+                n[k - 3] += err * 3;
+                n[k] += err * 5;
+                n[k + 3] += err;
+            }
+        }
+        std::swap(cur, next);
+    }
+}
+
+#endif //!_06_PALETTE_H
@@ -0,0 +1,89 @@
+#ifndef _06_SPOOL_H
+#define _06_SPOOL_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "logging.h"
+
+// fixed-size frames appended to an unlinked temp file, then mapped read-only for the second pass;
+// the page cache holds them, not the heap, so memory stays bounded however long the clip is
+class FrameSpool {
+public:
+    FrameSpool() = default;
+    FrameSpool(const FrameSpool&) = delete;
+    FrameSpool& operator=(const FrameSpool&) = delete;
+
+    ~FrameSpool()
+    {
+        if (data_) munmap(data_, size_);
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    int open(size_t frame_bytes)
+    {
+        const char * dir = std::getenv("TMPDIR");
+        std::string path = std::string(dir && *dir ? dir : "/tmp") + "/gen_gif.XXXXXX";
+
+        fd_ = mkstemp(path.data());
+        if (fd_ < 0) {
+            LOG(ERROR) << "mkstemp(" << path << ")";
+            return -1;
+        }
+        unlink(path.c_str());
+
+        frame_bytes_ = frame_bytes;
+        return 0;
+    }
+
+    int append(const uint8_t * frame)
+    {
+        size_t written = 0;
+        while (written < frame_bytes_) {
+            ssize_t ret = ::write(fd_, frame + written, frame_bytes_ - written);
+            if (ret < 0 && errno == EINTR) continue;
+            if (ret <= 0) {
+                LOG(ERROR) << "write spool: " << strerror(errno);
+                return -1;
+            }
+            written += ret;
+        }
+        nb_frames_++;
+        return 0;
+    }
+
+    // after the last append()
+    int map()
+    {
+        size_ = frame_bytes_ * nb_frames_;
+        if (!size_) return 0;
+
+        void * ptr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+        if (ptr == MAP_FAILED) {
+            LOG(ERROR) << "mmap spool: " << strerror(errno);
+            return -1;
+        }
+        data_ = static_cast<uint8_t *>(ptr);
+        madvise(data_, size_, MADV_SEQUENTIAL);
+        return 0;
+    }
+
+    const uint8_t * frame(size_t idx) const { return data_ + idx * frame_bytes_; }
+    size_t size() const { return nb_frames_; }
+
+private:
+    int fd_{ -1 };
+    size_t frame_bytes_{ 0 };
+    size_t nb_frames_{ 0 };
+
+    uint8_t * data_{ nullptr };
+    size_t size_{ 0 };
+};
+
+#endif //!_06_SPOOL_H
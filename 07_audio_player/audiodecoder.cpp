@@ -44,7 +44,8 @@ int AudioDecoder::open(const std::string& name)
 void AudioDecoder::audio_thread_f()
 {
     LOG(INFO) << "[AUDIO THREAD] STARTED@" << std::this_thread::get_id();
-    defer(LOG(INFO) << "[AUDIO THREAD] EXITED");
+    // also on errors, so that produce() reports EOF instead of EAGAIN forever
+    defer(stop(); LOG(INFO) << "[AUDIO THREAD] EXITED");
 
     while (running_) {
         av_packet_unref(packet_);
@@ -89,23 +90,38 @@ void AudioDecoder::audio_thread_f()
                 LOG(INFO) << fmt::format("[AUDIO THREAD] pts = {}", decoded_frame_->pts);
 
                 // decoded frame@{
-                while(buffer_.full() && running_) {
-                    av_usleep(30'0000);
-                }
-
                 buffer_.push([=](AVFrame* pushed){
                     av_frame_unref(pushed);
                     av_frame_move_ref(pushed, decoded_frame_);
                 });
+
+                // high watermark reached: sleep until produce() has drained the buffer to the low watermark
+                {
+                    std::unique_lock<std::mutex> lock(mtx_);
+                    produced_.notify_all();
+                    if (buffer_.size() >= high_) {
+                        refill_.wait(lock, [this]() { return buffer_.size() <= low_ || !running_; });
+                    }
+                }
                 // @}
             }
         } // audio_stream_idx
     } // running_
 }
 
+void AudioDecoder::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        running_ = false;
+    }
+    refill_.notify_all();
+    produced_.notify_all();
+}
+
 void AudioDecoder::destroy()
 {
-    running_ = false;
+    stop();
     opened_ = false;
     eof_ = false;
 
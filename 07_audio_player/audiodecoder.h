@@ -7,8 +7,11 @@ extern "C" {
 #include <libavutil/time.h>
 }
 #include <atomic>
+#include <algorithm>
 #include <mutex>
 #include <thread>
+#include <chrono>
+#include <condition_variable>
 #include "ringvector.h"
 #include "defer.h"
 #include "logging.h"
@@ -39,19 +42,47 @@ public:
 
     bool empty() const { return buffer_.empty(); }
 
+    // the decoder pauses once @high frames are buffered and resumes when produce() drains them to @low
+    void set_watermarks(size_t high, size_t low)
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        high_ = std::clamp<size_t>(high, 1, BUFFER_SIZE);
+        low_ = std::min(low, high_ - 1);
+    }
+
+    // non-blocking: EAGAIN if no frame is buffered yet, EOF once the decoder has finished and the buffer is drained
     int produce(AVFrame * frame)
     {
-        if (empty()) return AVERROR(EAGAIN);
-        if (empty() && eof_) return AVERROR_EOF;
+        // running_ first: the last frame is pushed before the thread stops
+        const bool finished = !running_;
+        if (empty()) return finished ? AVERROR_EOF : AVERROR(EAGAIN);
 
         buffer_.pop([frame](AVFrame* popped){
             av_frame_unref(frame);
             av_frame_move_ref(frame, popped);
         });
 
+        // wake the decoder as soon as it is allowed to refill
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if (buffer_.size() > low_) return 0;
+        }
+        refill_.notify_one();
+
         return 0;
     }
 
+    // blocking: waits up to @timeout for a frame, returns at once when the decoder stops
+    template<class Rep, class Period>
+    int produce(AVFrame * frame, const std::chrono::duration<Rep, Period>& timeout)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            produced_.wait_for(lock, timeout, [this]() { return !buffer_.empty() || !running_; });
+        }
+        return produce(frame);
+    }
+
     int sample_rate() const { return audio_decoder_ctx_ ? audio_decoder_ctx_->sample_rate : 44100; }
     enum AVSampleFormat format() const { return audio_decoder_ctx_ ? audio_decoder_ctx_->sample_fmt : AV_SAMPLE_FMT_NONE; }
     int channels() const { return audio_decoder_ctx_ ? audio_decoder_ctx_->channels : 0; }
@@ -63,8 +94,17 @@ public:
     }
 
 private:
+    void stop();
     void destroy();
 
+    static constexpr size_t BUFFER_SIZE = 16;
+
+    std::mutex mtx_;
+    std::condition_variable refill_;
+    std::condition_variable produced_;
+    size_t high_{ BUFFER_SIZE };
+    size_t low_{ BUFFER_SIZE / 2 };
+
     std::atomic<bool> running_{ false };
     std::atomic<bool> opened_{ false };
     std::atomic<bool> eof_{ false };
@@ -79,7 +119,7 @@ private:
     AVPacket* packet_{ nullptr };
     AVFrame* decoded_frame_{ nullptr };
 
-    RingVector<AVFrame*, 16> buffer_{
+    RingVector<AVFrame*, BUFFER_SIZE> buffer_{
             []() { return av_frame_alloc(); },
             [](AVFrame** frame) { av_frame_free(frame); }
     };
@@ -1,5 +1,5 @@
 #include "logging.h"
-#include "audiodecoder.h"
+#include "playlist.h"
 #include "audioplayer.h"
 extern "C" {
 #include <libavutil/audio_fifo.h>
@@ -9,46 +9,66 @@ extern "C" {
 int main(int argc, char *argv[])
 {
     Logger::init(argv[0]);
-    CHECK(argc >= 2) << "audio_player <input>";
+    CHECK(argc >= 2) << "audio_player <input> [<input> ...]";
 
-    AudioDecoder decoder;
-    CHECK(decoder.open(argv[1]) >= 0);
+    Playlist playlist(std::vector<std::string>(argv + 1, argv + argc));
+    CHECK(playlist.open() >= 0);
 
     AudioPlayer player;
     CHECK(player.open(48000, 2, av_get_bytes_per_sample(AV_SAMPLE_FMT_S16) * 8) >= 0);
 
-    auto swr_ctx_ = swr_alloc_set_opts(nullptr,
-                                       av_get_default_channel_layout(2), AV_SAMPLE_FMT_S16, 48000,
-                                       decoder.channel_layout(), decoder.format(), decoder.sample_rate(),
-                                       0, nullptr);
-
-    CHECK(swr_ctx_ && swr_init(swr_ctx_) >= 0);
+    // the items may differ in format, the resampler is re-created when the input changes
+    SwrContext * swr_ctx_ = nullptr; defer(swr_free(&swr_ctx_));
+    int in_format = AV_SAMPLE_FMT_NONE, in_sample_rate = 0;
+    uint64_t in_channel_layout = 0;
 
     AVFrame *decoded_frame = av_frame_alloc(); defer(av_frame_free(&decoded_frame));
     char * temp_buffer = nullptr; defer(av_freep(&temp_buffer));
     unsigned int temp_buffer_size = 0;
 
-    decoder.run();
-    while(!decoder.empty() || decoder.running()) {
-        if (decoder.empty()) {
+    auto write = [&](const uint8_t ** data, int nb_samples) {
+        int64_t max_bytes = swr_get_out_samples(swr_ctx_, nb_samples) * 2 * av_get_bytes_per_sample(AV_SAMPLE_FMT_S16);
+        av_fast_malloc(&temp_buffer, &temp_buffer_size, max_bytes);
+
+        int out_samples = swr_convert(swr_ctx_, (uint8_t **)&temp_buffer, swr_get_out_samples(swr_ctx_, nb_samples), data, nb_samples);
+        CHECK(out_samples >= 0);
+
+        int64_t frame_bytes = out_samples * 2 * av_get_bytes_per_sample(AV_SAMPLE_FMT_S16);
+        while (player.buffer_free_size() < frame_bytes) {
             av_usleep(15'000);
-            continue;
         }
+        player.write((const char *)temp_buffer, frame_bytes);
+    };
 
-        if (decoder.produce(decoded_frame) >= 0) {
-            int64_t frame_bytes = decoded_frame->nb_samples * 2 * av_get_bytes_per_sample(AV_SAMPLE_FMT_S16);
-            while (player.buffer_free_size() < frame_bytes) {
-                av_usleep(15'000);
-            }
+    while(true) {
+        // wakes up as soon as the decoder delivers, the timeout only bounds the wait
+        int ret = playlist.produce(decoded_frame, std::chrono::milliseconds(100));
+        if (ret == AVERROR_EOF) break;
 
-            av_fast_malloc(&temp_buffer, &temp_buffer_size, frame_bytes);
-            CHECK(swr_convert(swr_ctx_,
-                              (uint8_t **)&temp_buffer, decoded_frame->nb_samples,
-                              (const uint8_t**)decoded_frame->data, decoded_frame->nb_samples) >= 0);
+        if (ret >= 0) {
+            uint64_t channel_layout = decoded_frame->channel_layout ?
+                                      decoded_frame->channel_layout :
+                                      av_get_default_channel_layout(decoded_frame->channels);
+            if (decoded_frame->format != in_format || decoded_frame->sample_rate != in_sample_rate || channel_layout != in_channel_layout) {
+                // the samples still buffered in the resampler belong to the previous item
+                if (swr_ctx_) write(nullptr, 0);
+                swr_free(&swr_ctx_);
 
-            player.write((const char *)temp_buffer, frame_bytes);
+                in_format = decoded_frame->format;
+                in_sample_rate = decoded_frame->sample_rate;
+                in_channel_layout = channel_layout;
+                swr_ctx_ = swr_alloc_set_opts(nullptr,
+                                              av_get_default_channel_layout(2), AV_SAMPLE_FMT_S16, 48000,
+                                              in_channel_layout, static_cast<AVSampleFormat>(in_format), in_sample_rate,
+                                              0, nullptr);
+                CHECK(swr_ctx_ && swr_init(swr_ctx_) >= 0);
+            }
+
+            write((const uint8_t**)decoded_frame->data, decoded_frame->nb_samples);
         }
     }
 
+    if (swr_ctx_) write(nullptr, 0);
+
     return 0;
 }
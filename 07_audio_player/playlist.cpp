@@ -0,0 +1,46 @@
+#include "playlist.h"
+#include "fmt/core.h"
+
+int Playlist::open()
+{
+    if (files_.empty()) return -1;
+
+    prefetch(0);
+    advance();
+    return current_ ? 0 : -1;
+}
+
+void Playlist::prefetch(size_t idx)
+{
+    next_index_ = idx;
+    next_ = std::async(std::launch::async, [name = files_[idx]]() {
+        auto decoder = std::make_unique<AudioDecoder>();
+        if (decoder->open(name) < 0) {
+            LOG(ERROR) << "[PLAYLIST] failed to open " << name << ", skipped";
+            return std::unique_ptr<AudioDecoder>{};
+        }
+        // decodes until the buffer reaches the high watermark, then waits for the switch
+        decoder->run();
+        return decoder;
+    });
+}
+
+void Playlist::advance()
+{
+    current_.reset();
+
+    while (!current_ && next_.valid()) {
+        int64_t t0 = av_gettime_relative();
+        current_ = next_.get();
+        index_ = next_index_;
+
+        if (index_ + 1 < files_.size()) {
+            prefetch(index_ + 1);
+        }
+
+        if (current_) {
+            LOG(INFO) << fmt::format("[PLAYLIST] #{} {}, waited {} us for the prefetch",
+                                     index_, files_[index_], av_gettime_relative() - t0);
+        }
+    }
+}
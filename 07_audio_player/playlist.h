@@ -0,0 +1,52 @@
+#ifndef PLAYER_PLAYLIST
+#define PLAYER_PLAYLIST
+
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include "audiodecoder.h"
+
+// plays the items back to back: while one item is playing, the next one is opened, probed and
+// decoded up to the high watermark of its decoder in the background, so produce() moves on to it
+// at EOF without a gap
+class Playlist {
+public:
+    explicit Playlist(std::vector<std::string> files) : files_(std::move(files)) {}
+    Playlist(const Playlist&) = delete;
+    Playlist& operator=(const Playlist&) = delete;
+
+    // opens the first playable item and starts prefetching the one after it
+    int open();
+
+    // frames of all items in order, AVERROR_EOF after the last one
+    template<class Rep, class Period>
+    int produce(AVFrame * frame, const std::chrono::duration<Rep, Period>& timeout)
+    {
+        while (current_) {
+            int ret = current_->produce(frame, timeout);
+            if (ret != AVERROR_EOF) return ret;
+
+            advance();
+        }
+        return AVERROR_EOF;
+    }
+
+    // the item the last frame came from
+    AudioDecoder * current() const { return current_.get(); }
+    size_t index() const { return index_; }
+
+private:
+    void prefetch(size_t idx);
+    void advance();
+
+    std::vector<std::string> files_;
+
+    std::unique_ptr<AudioDecoder> current_;
+    size_t index_{ 0 };
+
+    std::future<std::unique_ptr<AudioDecoder>> next_;
+    size_t next_index_{ 0 };
+};
+
+#endif //!PLAYER_PLAYLIST
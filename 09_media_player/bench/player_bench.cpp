@@ -0,0 +1,224 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include "logging.h"
+#include "mediadecoder.h"
+#include "fmt/format.h"
+
+// headless MediaDecoder driver: the video sink only records the A/V sync error of each presented frame,
+// the audio sink is a virtual device that consumes periods in real time, or instantly with -fast
+struct VirtualAudioSink {
+    int64_t bytes_per_second{ 48000 * 4 };
+    int64_t capacity{ 4096 * 10 };      // as the QAudioOutput of the player
+    int64_t period{ 4096 };
+    bool fast{ false };
+
+    int64_t written{ 0 };
+    int64_t start_us{ AV_NOPTS_VALUE };
+    int64_t underruns{ 0 };
+
+    int64_t buffered()
+    {
+        if (fast || start_us == AV_NOPTS_VALUE) return 0;
+
+        int64_t played = (av_gettime_relative() - start_us) * bytes_per_second / AV_TIME_BASE;
+        if (played > written) {
+            // the device ran dry, it restarts from the next write
+            underruns++;
+            start_us = av_gettime_relative() - written * AV_TIME_BASE / bytes_per_second;
+            return 0;
+        }
+        return written - played;
+    }
+
+    // a period, or the rest at the end of the input
+    std::pair<int64_t, bool> consume(RingBuffer& buffer)
+    {
+        size_t read_size = std::min<size_t>(buffer.continuous_size(), static_cast<size_t>(period));
+        if (read_size == 0 || capacity - buffered() < period) {
+            return { buffered(), false };
+        }
+
+        buffer.read_ptr(read_size);
+
+        if (start_us == AV_NOPTS_VALUE) start_us = av_gettime_relative();
+        written += static_cast<int64_t>(read_size);
+        return { buffered(), true };
+    }
+};
+
+static double percentile(std::vector<int64_t>& values, double p)
+{
+    if (values.empty()) return 0;
+
+    auto nth = values.begin() + static_cast<ptrdiff_t>(p * (values.size() - 1));
+    std::nth_element(values.begin(), nth, values.end());
+    return static_cast<double>(*nth);
+}
+
+int main(int argc, char *argv[])
+{
+    Logger::init(argv[0]);
+
+    const char * usage = "player_bench <input> [-f <format>] [-vf <filters>] [-pix_fmt <fmt>] [-period <bytes>] "
+                         "[-size <w>x<h>] [-drop_ms <ms>] [-seek <seconds> [-precise]] [-fast] [-t <seconds>] [-v]";
+    if (argc < 2) {
+        LOG(ERROR) << usage;
+        return -1;
+    }
+
+    std::string input_file;
+    std::string format;
+    std::string filters;
+    int64_t drop_threshold_ms = -1;
+    double seek_to = -1;
+    bool precise = false;
+    int display_width = 0, display_height = 0;
+    AVPixelFormat pix_fmt = AV_PIX_FMT_BGRA;    // what the player converts to
+    VirtualAudioSink sink;
+    double duration = 0;
+    bool verbose = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp("-f", argv[i]) == 0 && i + 1 < argc) {
+            format = argv[++i];
+        }
+        else if (std::strcmp("-vf", argv[i]) == 0 && i + 1 < argc) {
+            filters = argv[++i];
+        }
+        else if (std::strcmp("-pix_fmt", argv[i]) == 0 && i + 1 < argc) {
+            pix_fmt = av_get_pix_fmt(argv[++i]);
+        }
+        else if (std::strcmp("-period", argv[i]) == 0 && i + 1 < argc) {
+            sink.period = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp("-drop_ms", argv[i]) == 0 && i + 1 < argc) {
+            drop_threshold_ms = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp("-seek", argv[i]) == 0 && i + 1 < argc) {
+            seek_to = std::atof(argv[++i]);
+        }
+        else if (std::strcmp("-precise", argv[i]) == 0) {
+            precise = true;
+        }
+        else if (std::strcmp("-size", argv[i]) == 0 && i + 1 < argc) {
+            CHECK(std::sscanf(argv[++i], "%dx%d", &display_width, &display_height) == 2) << usage;
+        }
+        else if (std::strcmp("-fast", argv[i]) == 0) {
+            sink.fast = true;
+        }
+        else if (std::strcmp("-t", argv[i]) == 0 && i + 1 < argc) {
+            duration = std::atof(argv[++i]);
+        }
+        else if (std::strcmp("-v", argv[i]) == 0) {
+            verbose = true;
+        }
+        else if (input_file.empty()) {
+            input_file = argv[i];
+        }
+        else {
+            LOG(ERROR) << usage;
+            return -1;
+        }
+    }
+    CHECK(!input_file.empty() && pix_fmt != AV_PIX_FMT_NONE && sink.period > 0) << usage;
+
+    // the per-frame logs of the decoder would dominate the measurement
+    if (!verbose) FLAGS_stderrthreshold = google::GLOG_WARNING;
+
+    // the callbacks run on the video and the audio thread of the decoder, which is declared last so that it is closed first
+    std::mutex mtx;
+    std::vector<int64_t> sync_errors;
+    sync_errors.reserve(1 << 16);
+
+    MediaDecoder decoder;
+    CHECK(decoder.open(input_file, format, filters, pix_fmt, {}));
+
+    sink.bytes_per_second = decoder.sample_rate() * 2 * av_get_bytes_per_sample(AV_SAMPLE_FMT_S16);
+    sink.capacity = std::max(sink.capacity, 2 * sink.period);
+
+    decoder.set_video_callback([&](AVFrame * frame) {
+        int64_t pts_us = av_rescale_q(frame->pts, decoder.timebase(), { 1, AV_TIME_BASE });
+        int64_t error = pts_us - decoder.clock_us();
+
+        std::lock_guard<std::mutex> lock(mtx);
+        sync_errors.push_back(error);
+    });
+    decoder.set_audio_callback([&](RingBuffer& buffer) { return sink.consume(buffer); });
+    decoder.set_period_size(sink.period);
+    decoder.set_display_size(display_width, display_height);
+    if (drop_threshold_ms >= 0) decoder.set_drop_threshold(drop_threshold_ms * 1000);
+
+    // queue occupancy is sampled every 10ms
+    std::vector<int64_t> video_queue, audio_queue, frame_queue;
+
+    const int64_t start = av_gettime_relative();
+    bool seeked = false;
+    decoder.start();
+    while (!decoder.finished() && (duration <= 0 || av_gettime_relative() - start < duration * AV_TIME_BASE)) {
+        // one second into the playback
+        if (seek_to >= 0 && !seeked && av_gettime_relative() - start >= AV_TIME_BASE) {
+            seeked = decoder.seek(static_cast<int64_t>(seek_to * AV_TIME_BASE), precise);
+            seek_to = seeked ? seek_to : -1;
+        }
+
+        auto stats = decoder.stats();
+        video_queue.push_back(static_cast<int64_t>(stats.video_packets));
+        audio_queue.push_back(static_cast<int64_t>(stats.audio_packets));
+        frame_queue.push_back(static_cast<int64_t>(stats.video_frames));
+        av_usleep(10'000);
+    }
+    const double elapsed = (av_gettime_relative() - start) / 1000000.0;
+    const auto stats = decoder.stats();
+    const bool finished = decoder.finished();
+
+    std::lock_guard<std::mutex> lock(mtx);
+
+    std::vector<int64_t> abs_errors(sync_errors.size());
+    std::transform(sync_errors.begin(), sync_errors.end(), abs_errors.begin(), [](int64_t e) { return std::abs(e); });
+    double mean = 0;
+    for (auto e : sync_errors) mean += static_cast<double>(e);
+    mean = sync_errors.empty() ? 0 : mean / sync_errors.size();
+
+    auto escape = [](const std::string& str) {
+        std::string escaped;
+        for (char c : str) {
+            if (c == '"' || c == '\\') escaped += '\\';
+            escaped += c;
+        }
+        return escaped;
+    };
+    auto mean_of = [](const std::vector<int64_t>& values) {
+        double sum = 0;
+        for (auto v : values) sum += static_cast<double>(v);
+        return values.empty() ? 0 : sum / values.size();
+    };
+    auto max_of = [](const std::vector<int64_t>& values) {
+        return values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+    };
+
+    fmt::print("{{\n"
+               "  \"input\": \"{}\",\n"
+               "  \"mode\": \"{}\",\n"
+               "  \"finished\": {},\n"
+               "  \"elapsed_s\": {:.3f},\n"
+               "  \"video\": {{ \"decoded\": {}, \"presented\": {}, \"dropped\": {}, \"skip_periods\": {}, \"decode_fps\": {:.2f} }},\n"
+               "  \"audio\": {{ \"decoded\": {}, \"underruns\": {} }},\n"
+               "  \"sync_error_ms\": {{ \"mean\": {:.3f}, \"p50\": {:.3f}, \"p90\": {:.3f}, \"p99\": {:.3f}, \"max\": {:.3f} }},\n"
+               "  \"queue\": {{ \"capacity\": {}, \"video_mean\": {:.2f}, \"video_max\": {}, \"audio_mean\": {:.2f}, \"audio_max\": {} }},\n"
+               "  \"frame_queue\": {{ \"capacity\": {}, \"mean\": {:.2f}, \"max\": {} }},\n"
+               "  \"seek\": {{ \"target_s\": {:.3f}, \"precise\": {}, \"latency_ms\": {:.3f} }}\n"
+               "}}\n",
+               escape(input_file), sink.fast ? "fast" : "realtime", finished, elapsed,
+               stats.decoded_video_frames, stats.presented_frames, stats.dropped_frames, stats.skip_periods, stats.decoded_video_frames / elapsed,
+               stats.decoded_audio_frames, sink.underruns,
+               mean / 1000.0,
+               percentile(abs_errors, 0.50) / 1000.0, percentile(abs_errors, 0.90) / 1000.0,
+               percentile(abs_errors, 0.99) / 1000.0, max_of(abs_errors) / 1000.0,
+               BUFFER_SIZE, mean_of(video_queue), max_of(video_queue), mean_of(audio_queue), max_of(audio_queue),
+               FRAME_BUFFER_SIZE, mean_of(frame_queue), max_of(frame_queue),
+               seeked ? seek_to : -1.0, precise, seeked ? stats.seek_latency_us / 1000.0 : -1.0);
+
+    return 0;
+}
@@ -7,7 +7,7 @@ int main(int argc, char *argv[])
     Logger::init(argv[0]);
 
     if (argc < 2) {
-        LOG(ERROR) << "player <input>";
+        LOG(ERROR) << "player <input> [<input> ...]";
         return -1;
     }
 
@@ -17,10 +17,10 @@ int main(int argc, char *argv[])
     VideoPlayer player;
     player.show();
 
-    // filepath
-    player.play(argv[1]);
+    // filepaths, played one after another
+    player.play({ argv + 1, argv + argc });
     // find your camera devices: ffmpeg -hide_banner -f dshow -list_devices true -i dummy
-    //player.play("video=HD WebCam", "dshow", "hflip");
+    //player.play({ "video=HD WebCam" }, "dshow", "hflip");
 
     return a.exec();
 }
@@ -0,0 +1,152 @@
+#ifndef PLAYER_FRAME_CACHE
+#define PLAYER_FRAME_CACHE
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <map>
+
+// filtered frames keyed by pts, bounded by the bytes of their buffers, the least recently used ones are evicted.
+// not thread-safe, only the size counters may be read from other threads
+class FrameCache {
+public:
+    explicit FrameCache(size_t capacity) : capacity_(capacity) {}
+    FrameCache(const FrameCache&) = delete;
+    FrameCache& operator=(const FrameCache&) = delete;
+    ~FrameCache() { clear(); }
+
+    void set_capacity(size_t bytes)
+    {
+        capacity_ = bytes;
+        if (!capacity_) clear();
+        evict();
+    }
+
+    // takes a new reference, replaces a frame with the same pts
+    void insert(const AVFrame * frame)
+    {
+        if (!capacity_ || frame->pts == AV_NOPTS_VALUE) return;
+
+        erase(frame->pts);
+
+        Entry entry{ av_frame_alloc(), 0, {} };
+        if (!entry.frame || av_frame_ref(entry.frame, frame) < 0) {
+            av_frame_free(&entry.frame);
+            return;
+        }
+        for (const auto buf : entry.frame->buf) {
+            if (buf) entry.bytes += buf->size;
+        }
+
+        lru_.push_front(frame->pts);
+        entry.lru = lru_.begin();
+        bytes_ += entry.bytes;
+        frames_.emplace(frame->pts, entry);
+        count_ = frames_.size();
+
+        evict();
+    }
+
+    // the frame with the largest pts before / smallest pts after @pts, nullptr if there is none
+    AVFrame * prev(int64_t pts)
+    {
+        auto it = frames_.lower_bound(pts);
+        return it == frames_.begin() ? nullptr : touch(std::prev(it));
+    }
+
+    AVFrame * next(int64_t pts)
+    {
+        auto it = frames_.upper_bound(pts);
+        return it == frames_.end() ? nullptr : touch(it);
+    }
+
+    bool contains(int64_t pts) const { return frames_.count(pts) > 0; }
+
+    // the smallest pts at or after @pts, AV_NOPTS_VALUE if there is none; does not count as a use
+    int64_t first_from(int64_t pts) const
+    {
+        auto it = frames_.lower_bound(pts);
+        return it == frames_.end() ? AV_NOPTS_VALUE : it->first;
+    }
+
+    // frames with a pts in [@from, @to) are not evicted, even if they alone exceed the capacity; pin(0, 0) releases them
+    void pin(int64_t from, int64_t to)
+    {
+        pin_from_ = from;
+        pin_to_ = to;
+        evict();
+    }
+
+    // frames with a pts in [@from, @to)
+    size_t count(int64_t from, int64_t to) const
+    {
+        return from < to ? std::distance(frames_.lower_bound(from), frames_.lower_bound(to)) : 0;
+    }
+
+    void clear()
+    {
+        for (auto& [pts, entry] : frames_) av_frame_free(&entry.frame);
+        frames_.clear();
+        lru_.clear();
+        bytes_ = 0;
+        count_ = 0;
+        pin_from_ = pin_to_ = 0;
+    }
+
+    size_t bytes() const { return bytes_; }
+    size_t size() const { return count_; }
+
+private:
+    struct Entry {
+        AVFrame * frame;
+        size_t bytes;
+        std::list<int64_t>::iterator lru;
+    };
+
+    AVFrame * touch(std::map<int64_t, Entry>::iterator it)
+    {
+        lru_.splice(lru_.begin(), lru_, it->second.lru);
+        return it->second.frame;
+    }
+
+    void erase(int64_t pts)
+    {
+        auto it = frames_.find(pts);
+        if (it == frames_.end()) return;
+
+        bytes_ -= it->second.bytes;
+        lru_.erase(it->second.lru);
+        av_frame_free(&it->second.frame);
+        frames_.erase(it);
+        count_ = frames_.size();
+    }
+
+    // the least recently used frame that is not pinned goes first; the most recent one always stays, even if it
+    // alone is larger than the capacity
+    void evict()
+    {
+        auto it = lru_.end();
+        while (bytes_ > capacity_ && it != lru_.begin() && std::prev(it) != lru_.begin()) {
+            const int64_t pts = *--it;
+            if (pts >= pin_from_ && pts < pin_to_) continue;
+
+            ++it;
+            erase(pts);
+        }
+    }
+
+    size_t capacity_;
+    std::map<int64_t, Entry> frames_;
+    std::list<int64_t> lru_;                // front: the most recently used
+    int64_t pin_from_{ 0 };
+    int64_t pin_to_{ 0 };
+
+    std::atomic<size_t> bytes_{ 0 };
+    std::atomic<size_t> count_{ 0 };
+};
+
+#endif // !PLAYER_FRAME_CACHE
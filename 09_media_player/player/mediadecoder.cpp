@@ -164,6 +164,8 @@ bool MediaDecoder::open(const std::string& name,
     CHECK_NE(decoded_video_frame_ = av_frame_alloc(), nullptr);
     CHECK_NE(decoded_audio_frame_ = av_frame_alloc(), nullptr);
     CHECK_NE(filtered_frame_ = av_frame_alloc(), nullptr);
+    CHECK_NE(scaled_frame_ = av_frame_alloc(), nullptr);
+    CHECK_NE(presented_frame_ = av_frame_alloc(), nullptr);
 
     opened_ = true;
     LOG(INFO) << "[DECODER]: " << name << " is opened";
@@ -178,6 +180,7 @@ bool MediaDecoder::create_filters()
         LOG(ERROR) << "avfilter_graph_alloc";
         return false;
     }
+    filter_threading_.apply(filter_graph_);
 
     const AVFilter* buffersrc = avfilter_get_by_name("buffer");
     const AVFilter* buffersink = avfilter_get_by_name("buffersink");
@@ -204,11 +207,8 @@ bool MediaDecoder::create_filters()
         LOG(ERROR) << "avfilter_graph_create_filter(buffersink)";
         return false;
     }
-    enum AVPixelFormat pix_fmts[] = { pix_fmt_, AV_PIX_FMT_NONE };
-    if (av_opt_set_int_list(buffersink_ctx_, "pix_fmts", pix_fmts, AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN) < 0) {
-        LOG(ERROR) << "av_opt_set_int_list";
-        return false;
-    }
+    // the sink takes any pixel format: the conversion to pix_fmt_ is done together with the scaling to the display size,
+    // see scale_frame(), instead of converting at full resolution here
 
     if (filters_descr_.length() > 0) {
         AVFilterInOut* inputs = nullptr;
@@ -255,10 +255,15 @@ bool MediaDecoder::create_filters()
 void MediaDecoder::read_thread_f()
 {
     LOG(INFO) << "[READ THREAD] STARTED@" << std::this_thread::get_id();
-    defer(LOG(INFO) << "[READ THREAD] EXITED");
+    defer(read_finished_ = true; LOG(INFO) << "[READ THREAD] EXITED");
 
+    bool eof = false;
     while (running()) {
-        if (paused()) {
+        // served here, so that no packet of the old position is read after the queues are flushed
+        if (do_seek()) eof = false;
+
+        // at the end of the input only a seek resumes reading
+        if (paused() || eof) {
             std::this_thread::sleep_for(20ms);
             continue;
         }
@@ -278,7 +283,8 @@ void MediaDecoder::read_thread_f()
                 video_packet_buffer_.push([this](AVPacket* packet) { av_packet_unref(packet); });
                 audio_packet_buffer_.push([this](AVPacket* packet) { av_packet_unref(packet); });
 
-                return;
+                eof = true;
+                continue;
             }
 
             LOG(ERROR) << "[READ THREAD] read frame failed";
@@ -305,10 +311,82 @@ void MediaDecoder::read_thread_f()
     }
 }
 
+bool MediaDecoder::seek(int64_t ts_us, bool precise)
+{
+    if (!running() || read_finished_) {
+        LOG(WARNING) << "[DECODER] not seekable, not started or reading the input failed";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(seek_mtx_);
+    seek_req_ = true;
+    seek_ts_ = std::max<int64_t>(0, ts_us);
+    seek_precise_ = precise;
+    seek_start_us_ = av_gettime_relative();
+    return true;
+}
+
+bool MediaDecoder::do_seek()
+{
+    int64_t ts_us = 0;
+    bool precise = false;
+    {
+        std::lock_guard<std::mutex> lock(seek_mtx_);
+        if (!seek_req_) return false;
+
+        seek_req_ = false;
+        ts_us = seek_ts_;
+        precise = seek_precise_;
+    }
+
+    // the keyframe at or before the target, any stream
+    const int64_t start_time = fmt_ctx_->start_time == AV_NOPTS_VALUE ? 0 : fmt_ctx_->start_time;
+    if (avformat_seek_file(fmt_ctx_, -1, INT64_MIN, start_time + ts_us, start_time + ts_us, 0) < 0) {
+        LOG(ERROR) << "[READ THREAD] avformat_seek_file failed, ts = " << ts_us;
+        return false;
+    }
+
+    const int serial = ++serial_;
+
+    // the queued packets belong to the old position; the decoding threads flush their decoder, filter graph and
+    // audio buffer when they meet the flush packet, which carries the precise target and the serial of this seek:
+    // serial_ may already belong to a later seek when they get there
+    video_packet_buffer_.clear();
+    audio_packet_buffer_.clear();
+    auto flush = [=](AVPacket * packet) {
+        av_packet_unref(packet);
+        packet->stream_index = -1;
+        packet->pts = precise ? ts_us : AV_NOPTS_VALUE;
+        packet->dts = serial;
+    };
+    video_packet_buffer_.push(flush);
+    audio_packet_buffer_.push(flush);
+
+    set_clock(ts_us);
+
+    LOG(INFO) << fmt::format("[READ THREAD] SEEK TO {:.3f}s{}, serial = {}", ts_us / 1000000.0, precise ? ", precise" : "", serial);
+    return true;
+}
+
+void MediaDecoder::set_clock(int64_t us)
+{
+    const int64_t now = av_gettime_relative();
+    audio_clock_ = us;
+    audio_clock_ts_ = now;
+    first_pts_ = now - us;
+}
+
 void MediaDecoder::video_thread_f()
 {
     LOG(INFO) << "[VIDEO THREAD] STARTED@" << std::this_thread::get_id();
-    defer(LOG(INFO) << "[VIDEO THREAD] EXITED");
+    int serial = 0;
+    // also on errors and without a video stream, so that the presentation thread stops waiting for frames
+    defer(video_finished_ = true; push_video_frame(nullptr, serial); LOG(INFO) << "[VIDEO THREAD] EXITED");
+
+    int64_t seek_target_us = AV_NOPTS_VALUE;
+
+    const AVRational framerate = this->framerate();
+    const int64_t frame_us = (framerate.num > 0 && framerate.den > 0) ? av_rescale_q(1, av_inv_q(framerate), { 1, AV_TIME_BASE }) : 0;
 
     while(video_stream_index_ >=0 && running()) {
         if (video_packet_buffer_.empty()) {
@@ -321,6 +399,34 @@ void MediaDecoder::video_thread_f()
             av_packet_move_ref(video_packet_, popped);
         });
 
+        // flush packet of a seek
+        if (video_packet_->stream_index < 0) {
+            avcodec_flush_buffers(video_decoder_ctx_);
+
+            avfilter_graph_free(&filter_graph_);
+            if (!create_filters()) {
+                LOG(ERROR) << "[VIDEO THREAD] create_filters";
+                return;
+            }
+
+            late_frames_ = 0;
+            skipping_ = false;
+            video_decoder_ctx_->skip_frame = AVDISCARD_DEFAULT;
+            video_decoder_ctx_->skip_loop_filter = AVDISCARD_DEFAULT;
+
+            serial = static_cast<int>(video_packet_->dts);
+            seek_target_us = video_packet_->pts;
+            continue;
+        }
+
+        // precise seek: a frame before the target that no other frame references is not decoded at all
+        if (seek_target_us != AV_NOPTS_VALUE && video_packet_->pts != AV_NOPTS_VALUE) {
+            const AVStream * stream = fmt_ctx_->streams[video_stream_index_];
+            const int64_t start_time = stream->start_time == AV_NOPTS_VALUE ? 0 : stream->start_time;
+            const int64_t pkt_us = av_rescale_q(video_packet_->pts - start_time, stream->time_base, { 1, AV_TIME_BASE });
+            video_decoder_ctx_->skip_frame = (pkt_us + frame_us <= seek_target_us || skipping_) ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+        }
+
         int ret = avcodec_send_packet(video_decoder_ctx_, video_packet_);
         while (ret >= 0) {
             av_frame_unref(decoded_video_frame_);
@@ -328,21 +434,42 @@ void MediaDecoder::video_thread_f()
             if (ret == AVERROR(EAGAIN)) {
                 break;
             }
-            else if (ret == AVERROR_EOF) { // fully flushed, exit
+            else if (ret == AVERROR_EOF) { // fully flushed, wait for a seek
                 // [flushing] 3. Before decoding can be resumed again, the codec has to be reset with avcodec_flush_buffers()
                 avcodec_flush_buffers(video_decoder_ctx_);
                 LOG(INFO) << "[VIDEO THREAD] EOF";
-                return;
+                if (!push_video_frame(nullptr, serial)) return;
+                break;
             }
             else if (ret < 0) { // error, exit
                 LOG(ERROR) << "[VIDEO THREAD] legitimate decoding errors";
                 return;
             }
 
+            decoded_video_frames_++;
             decoded_video_frame_->pts = (decoded_video_frame_->pts == AV_NOPTS_VALUE) ?
                                         av_rescale_q(av_gettime_relative() - first_pts_, { 1, AV_TIME_BASE }, fmt_ctx_->streams[video_packet_->stream_index]->time_base) :
                                         decoded_video_frame_->pts - fmt_ctx_->streams[video_packet_->stream_index]->start_time;
 
+            // precise seek: the frames before the target are neither filtered nor converted
+            if (seek_target_us != AV_NOPTS_VALUE) {
+                int64_t frame_pts_us = av_rescale_q(decoded_video_frame_->pts, fmt_ctx_->streams[video_stream_index_]->time_base, { 1, AV_TIME_BASE });
+                if (frame_pts_us + frame_us <= seek_target_us) continue;
+
+                seek_target_us = AV_NOPTS_VALUE;
+                video_decoder_ctx_->skip_frame = skipping_ ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+            }
+
+            // the clock does not run while stepping or prepared, and a GOP fill needs every frame
+            if (mode_ == PlaybackMode::FORWARD && !held_) {
+                update_skipping(av_rescale_q(decoded_video_frame_->pts, fmt_ctx_->streams[video_packet_->stream_index]->time_base, { 1, AV_TIME_BASE }) - clock_us());
+            }
+            else if (skipping_) {
+                video_decoder_ctx_->skip_frame = AVDISCARD_DEFAULT;
+                video_decoder_ctx_->skip_loop_filter = AVDISCARD_DEFAULT;
+                skipping_ = false;
+            }
+
             if (av_buffersrc_add_frame_flags(buffersrc_ctx_, decoded_video_frame_, AV_BUFFERSRC_FLAG_PUSH) < 0) {
                 LOG(ERROR) << "av_buffersrc_add_frame(buffersrc_ctx_, frame_)";
                 break;
@@ -354,30 +481,315 @@ void MediaDecoder::video_thread_f()
                     break;
                 }
 
-                int64_t pts_us = av_rescale_q(filtered_frame_->pts, fmt_ctx_->streams[video_packet_->stream_index]->time_base, { 1, AV_TIME_BASE });
-                int64_t sleep_us = std::min<int64_t>(std::max<int64_t>(0, pts_us - clock_us()), AV_TIME_BASE);
+                // the timing is left to the presentation thread, decoding runs ahead until the queue is full
+                if (!scale_frame(filtered_frame_, scaled_frame_)) {
+                    LOG(ERROR) << "[VIDEO THREAD] scale_frame";
+                    continue;
+                }
+
+                if (!push_video_frame(scaled_frame_, serial)) return;
+            }
+        }
+    }
+}
+
+void MediaDecoder::update_skipping(int64_t lateness_us)
+{
+    const int64_t threshold = drop_threshold_us_;
+    if (threshold <= 0) return;
+
+    // sustained: a few frames in a row, so that a single slow frame does not toggle it
+    late_frames_ = (lateness_us < -threshold) ? late_frames_ + 1 : 0;
+
+    if (!skipping_ && late_frames_ >= 8) {
+        video_decoder_ctx_->skip_frame = AVDISCARD_NONREF;
+        video_decoder_ctx_->skip_loop_filter = AVDISCARD_NONREF;
+        skipping_ = true;
+        skip_periods_++;
+        LOG(WARNING) << fmt::format("[VIDEO THREAD] {:.3f}s behind the clock, skipping non-reference frames", -lateness_us / 1000000.0);
+    }
+    // caught up: the decoder is ahead of the clock again
+    else if (skipping_ && lateness_us >= 0) {
+        video_decoder_ctx_->skip_frame = AVDISCARD_DEFAULT;
+        video_decoder_ctx_->skip_loop_filter = AVDISCARD_DEFAULT;
+        skipping_ = false;
+        LOG(WARNING) << "[VIDEO THREAD] caught up, decoding all frames";
+    }
+}
+
+bool MediaDecoder::scale_frame(const AVFrame * in, AVFrame * out)
+{
+    const uint64_t display_size = display_size_;
+    int width = static_cast<int>(display_size >> 32);
+    int height = static_cast<int>(display_size & 0xffffffff);
+    if (width <= 0 || height <= 0) {
+        width = in->width;
+        height = in->height;
+    }
+
+    av_frame_unref(out);
+
+    if (width == in->width && height == in->height && in->format == pix_fmt_) {
+        return av_frame_ref(out, in) >= 0;
+    }
+
+    sws_ctx_ = sws_getCachedContext(sws_ctx_,
+                                    in->width, in->height, static_cast<AVPixelFormat>(in->format),
+                                    width, height, pix_fmt_,
+                                    SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if (!sws_ctx_) return false;
+
+    // the frames still on screen, queued or cached keep the old pool alive until they are released
+    const int size = av_image_get_buffer_size(pix_fmt_, width, height, 32);
+    if (size < 0) return false;
+    if (!scale_pool_ || size != scale_pool_size_) {
+        av_buffer_pool_uninit(&scale_pool_);
+        scale_pool_ = av_buffer_pool_init(size, nullptr);
+        scale_pool_size_ = size;
+        LOG(INFO) << fmt::format("[VIDEO THREAD] {}x{} -> {}x{} {}",
+                                 in->width, in->height, width, height, av_get_pix_fmt_name(pix_fmt_));
+    }
+
+    if (!scale_pool_ || !(out->buf[0] = av_buffer_pool_get(scale_pool_))) return false;
+
+    av_image_fill_arrays(out->data, out->linesize, out->buf[0]->data, pix_fmt_, width, height, 32);
+    out->width = width;
+    out->height = height;
+    out->format = pix_fmt_;
+    av_frame_copy_props(out, in);
+
+    sws_scale(sws_ctx_, in->data, in->linesize, 0, in->height, out->data, out->linesize);
+    return true;
+}
+
+bool MediaDecoder::push_video_frame(AVFrame * frame, int serial)
+{
+    // single producer: once there is room, the push can not overwrite a queued frame
+    while (!video_frame_buffer_.wait_not_full(10ms)) {
+        if (!running()) return false;
+    }
+
+    video_frame_buffer_.push([frame, serial](AVFrame * pushed) {
+        av_frame_unref(pushed);
+        if (frame) av_frame_move_ref(pushed, frame);
+        pushed->opaque = reinterpret_cast<void *>(static_cast<intptr_t>(serial));
+    });
+    return true;
+}
+
+void MediaDecoder::present_thread_f()
+{
+    LOG(INFO) << "[PRESENT THREAD] STARTED@" << std::this_thread::get_id();
+    defer(LOG(INFO) << "[PRESENT THREAD] EXITED");
+
+    int presented_serial = 0;
+    PlaybackMode last_mode = PlaybackMode::FORWARD;
 
-                LOG(INFO) << fmt::format("[VIDEO THREAD] pts = {:>6.3f}s, clock = {:>6.3f}s, sleep = {:>4d}ms, frame = {:>4d}, fps = {:>5.2f}, ts = {:>6.3f}s",
-                                         pts_us / 1000000.0, clock_s(), sleep_us / 1000,
-                                         video_decoder_ctx_->frame_number, video_decoder_ctx_->frame_number / clock_s(),
-                                         (av_gettime_relative() - first_pts_) / 1000000.0);
+    while (running()) {
+        const PlaybackMode mode = mode_;
+        if (mode != PlaybackMode::FORWARD) {
+            last_mode = mode;
+            present_cached(mode);
+            continue;
+        }
+
+        // back from stepping: continue at the frame on screen, the precise seek also brings the audio back in sync
+        if (last_mode != PlaybackMode::FORWARD) {
+            last_mode = PlaybackMode::FORWARD;
+            pending_steps_ = 0;
+            if (current_pts_ != AV_NOPTS_VALUE) seek(pts_to_us(current_pts_), true);
+        }
+
+        // prepared: the decoded frames wait in the queue until start()
+        if (held_ || !video_frame_buffer_.wait_not_empty(10ms)) {
+            if (held_) std::this_thread::sleep_for(10ms);
+            continue;
+        }
+
+        video_frame_buffer_.pop([this](AVFrame * popped) {
+            av_frame_unref(presented_frame_);
+            av_frame_move_ref(presented_frame_, popped);
+        });
+
+        // decoded before the last seek
+        const int serial = static_cast<int>(reinterpret_cast<intptr_t>(presented_frame_->opaque));
+        if (serial != serial_) continue;
+
+        // the last frame stays on screen, a seek or a step backwards goes on from there
+        if (!presented_frame_->width && !presented_frame_->height) {
+            if (!video_eof_) LOG(INFO) << "[PRESENT THREAD] EOF";
+            video_eof_ = true;
+            video_eof_serial_ = serial;
+            continue;
+        }
+        video_eof_ = false;
+
+        // dropped or not, so that stepping backwards right after pausing does not need to decode
+        frame_cache_.insert(presented_frame_);
+
+        int64_t pts_us = av_rescale_q(presented_frame_->pts, fmt_ctx_->streams[video_stream_index_]->time_base, { 1, AV_TIME_BASE });
+
+        // first frame after a seek: the clock restarts at it, the audio thread corrects it with its first frame
+        if (serial != presented_serial) {
+            presented_serial = serial;
+            set_clock(pts_us);
+            seek_latency_us_ = av_gettime_relative() - seek_start_us_;
+            LOG(INFO) << fmt::format("[PRESENT THREAD] first frame after seek, pts = {:.3f}s, latency = {:.3f}ms", pts_us / 1000000.0, seek_latency_us_ / 1000.0);
+        }
+
+        // too late: drop it if a newer frame is already waiting, otherwise show it rather than nothing
+        const int64_t threshold = drop_threshold_us_;
+        if (threshold > 0 && pts_us - clock_us() < -threshold && !video_frame_buffer_.empty()) {
+            dropped_frames_++;
+            LOG(INFO) << fmt::format("[PRESENT THREAD] pts = {:>6.3f}s, clock = {:>6.3f}s, dropped", pts_us / 1000000.0, clock_s());
+            continue;
+        }
+
+        int64_t sleep_us = std::min<int64_t>(std::max<int64_t>(0, pts_us - clock_us()), AV_TIME_BASE);
+
+        LOG(INFO) << fmt::format("[PRESENT THREAD] pts = {:>6.3f}s, clock = {:>6.3f}s, sleep = {:>4d}ms, frame = {:>4d}, fps = {:>5.2f}, queued = {}, ts = {:>6.3f}s",
+                                 pts_us / 1000000.0, clock_s(), sleep_us / 1000,
+                                 video_decoder_ctx_->frame_number, video_decoder_ctx_->frame_number / clock_s(),
+                                 video_frame_buffer_.size(), (av_gettime_relative() - first_pts_) / 1000000.0);
+
+        // in slices, so that a seek does not wait for a frame of the old position
+        while (sleep_us > 0 && serial == serial_ && mode_ == PlaybackMode::FORWARD && running()) {
+            const int64_t slice = std::min<int64_t>(sleep_us, 10'000);
+            av_usleep(static_cast<unsigned>(slice));
+            sleep_us -= slice;
+        }
+        if (serial != serial_ || mode_ != PlaybackMode::FORWARD) continue;
+
+        show(presented_frame_);
+    }
+}
+
+void MediaDecoder::show(AVFrame * frame)
+{
+    video_callback_(frame);
+    presented_frames_++;
+    current_pts_ = frame->pts;
+}
+
+void MediaDecoder::present_cached(PlaybackMode mode)
+{
+    pending_steps_ += step_req_.exchange(0);
+
+    // reverse playback: one step back whenever the previous frame is due
+    if (mode == PlaybackMode::REVERSE && pending_steps_ == 0 && av_gettime_relative() >= reverse_due_) {
+        pending_steps_ = -1;
+    }
 
-                av_usleep(sleep_us);
+    receive_frames();
+
+    if (pending_steps_ == 0 || current_pts_ == AV_NOPTS_VALUE) {
+        pending_steps_ = 0;
+        std::this_thread::sleep_for(5ms);
+        return;
+    }
+
+    AVFrame * frame = (pending_steps_ < 0) ? frame_cache_.prev(current_pts_) : frame_cache_.next(current_pts_);
+    if (frame) {
+        const int64_t interval = std::abs(pts_to_us(current_pts_) - pts_to_us(frame->pts));
+        show(frame);
+        pending_steps_ += (pending_steps_ < 0) ? 1 : -1;
+        reverse_due_ = av_gettime_relative() + std::min<int64_t>(interval, AV_TIME_BASE);
+
+        // close to the start of the decoded GOP: decode the one before it meanwhile
+        if (fill_done_ && fill_floor_ != AV_NOPTS_VALUE && fill_until_ != fill_floor_ &&
+            frame_cache_.count(fill_floor_, current_pts_) < FRAME_BUFFER_SIZE && !frame_cache_.count(INT64_MIN, fill_floor_)) {
+            request_fill(fill_floor_);
+        }
+        return;
+    }
 
-                video_callback_(filtered_frame_);
+    if (pending_steps_ < 0) {
+        // a fill up to this frame has already run and found nothing before it
+        if (fill_done_ && fill_until_ == current_pts_) {
+            LOG(INFO) << "[PRESENT THREAD] no frame before " << current_pts_;
+            pending_steps_ = 0;
+            mode_ = PlaybackMode::STEPPING;
+        }
+        else if (fill_done_) {
+            request_fill(current_pts_);
+        }
+    }
+    else if (video_eof_) {
+        pending_steps_ = 0;
+    }
+}
+
+// frames are taken from the decoder only while a GOP is being filled or a forward step waits for the next one,
+// otherwise the decoder stops at the full frame queue
+void MediaDecoder::receive_frames()
+{
+    while (running()) {
+        const bool wanted = !fill_done_ || (pending_steps_ > 0 && !video_eof_ && !frame_cache_.count(current_pts_ + 1, INT64_MAX));
+        if (!wanted || !video_frame_buffer_.wait_not_empty(5ms)) return;
+
+        video_frame_buffer_.pop([this](AVFrame * popped) {
+            av_frame_unref(presented_frame_);
+            av_frame_move_ref(presented_frame_, popped);
+        });
+
+        const int serial = static_cast<int>(reinterpret_cast<intptr_t>(presented_frame_->opaque));
+        if (serial != serial_) continue;
+
+        if (!presented_frame_->width && !presented_frame_->height) {
+            video_eof_ = true;
+            video_eof_serial_ = serial;
+            fill_done_ = true;
+            frame_cache_.pin(0, 0);
+            return;
+        }
+        video_eof_ = false;
+
+        // the frame a fill ends at is cached already, inserting it again would make it the one frame that is never evicted
+        const bool filling = !fill_done_ && serial == fill_serial_;
+        if (!filling || presented_frame_->pts < fill_until_ || !frame_cache_.contains(presented_frame_->pts)) {
+            frame_cache_.insert(presented_frame_);
+        }
+
+        if (filling) {
+            if (fill_first_ == AV_NOPTS_VALUE) fill_first_ = presented_frame_->pts;
+
+            if (presented_frame_->pts >= fill_until_) {
+                // a GOP larger than the cache keeps only its last frames, the next fill goes on below them
+                fill_done_ = true;
+                fill_floor_ = frame_cache_.first_from(fill_first_);
+                frame_cache_.pin(0, 0);
+                LOG(INFO) << fmt::format("[PRESENT THREAD] GOP [{}, {}) decoded, [{}, {}) cached, {} frames, {} MiB in the cache",
+                                         fill_first_, fill_until_, fill_floor_, fill_until_,
+                                         frame_cache_.count(fill_floor_, fill_until_), frame_cache_.bytes() >> 20);
             }
         }
     }
 }
 
+void MediaDecoder::request_fill(int64_t until)
+{
+    fill_until_ = until;
+    fill_first_ = AV_NOPTS_VALUE;
+
+    // the frames from @until to the one on screen are still to be shown backwards, the fill must not evict them
+    frame_cache_.pin(until, current_pts_ + 1);
+
+    // the keyframe at or before the frame preceding @until; served by the read thread, which starts the next serial
+    fill_serial_ = serial_ + 1;
+    fill_done_ = !seek(std::max<int64_t>(0, pts_to_us(until) - 1), false);
+    if (fill_done_) frame_cache_.pin(0, 0);
+}
+
 void MediaDecoder::audio_thread_f()
 {
     LOG(INFO) << "[AUDIO THREAD] STARTED@" << std::this_thread::get_id();
-    defer(LOG(INFO) << "[AUDIO THREAD] EXITED");
+    defer(audio_finished_ = true; LOG(INFO) << "[AUDIO THREAD] EXITED");
 
     LOG(INFO) << "[AUDIO THREAD] period size = " << period_size_;
     RingBuffer ring_buffer(std::max<size_t>(period_size_, 4096) * 2);
     int64_t buffered_size = 0;
+    int serial = 0;
+    int64_t seek_target_us = AV_NOPTS_VALUE;
 
     while(audio_stream_index_ >= 0 && running()) {
         if (audio_packet_buffer_.empty()) {
@@ -390,6 +802,19 @@ void MediaDecoder::audio_thread_f()
             av_packet_move_ref(audio_packet_, popped);
         });
 
+        // flush packet of a seek, the samples already written to the audio device are still played
+        if (audio_packet_->stream_index < 0) {
+            avcodec_flush_buffers(audio_decoder_ctx_);
+            ring_buffer.clear();
+            swr_init(swr_ctx_);
+            serial = static_cast<int>(audio_packet_->dts);
+            seek_target_us = audio_packet_->pts;
+            continue;
+        }
+
+        // silent while stepping, play_forward() seeks back to the frame on screen
+        if (mode_ != PlaybackMode::FORWARD) continue;
+
         int ret = avcodec_send_packet(audio_decoder_ctx_, audio_packet_);
         while (ret >= 0) {
             av_frame_unref(decoded_audio_frame_);
@@ -397,20 +822,43 @@ void MediaDecoder::audio_thread_f()
             if (ret == AVERROR(EAGAIN) ) {
                 break;
             }
-            else if (ret == AVERROR_EOF) { // fully flushed, exit
+            else if (ret == AVERROR_EOF) { // fully flushed, wait for a seek
                 avcodec_flush_buffers(audio_decoder_ctx_);
+
+                // the rest is less than a period, written too so that the next item of a playlist follows without a gap
+                while (!ring_buffer.empty() && mode_ == PlaybackMode::FORWARD && running()) {
+                    ring_buffer.defrag();
+
+                    auto [written_size, ok] = audio_callback_(ring_buffer);
+                    buffered_size = written_size;
+
+                    if (!ok) {
+                        av_usleep(15000);
+                    }
+                }
+                audio_eof_serial_ = serial;
                 LOG(INFO) << "[AUDIO THREAD] EOF";
-                return;
+                break;
             }
             else if (ret < 0) { // error, exit
                 LOG(ERROR) << "[AUDIO THREAD] legitimate decoding errors";
                 return;
             }
 
+            decoded_audio_frames_++;
             decoded_audio_frame_->pts = (decoded_audio_frame_->pts == AV_NOPTS_VALUE) ?
                                         av_rescale_q(av_gettime_relative() - first_pts_, { 1, AV_TIME_BASE }, fmt_ctx_->streams[audio_packet_->stream_index]->time_base) :
                                         decoded_audio_frame_->pts - fmt_ctx_->streams[audio_packet_->stream_index]->start_time;
 
+            // precise seek: whole frames before the target are discarded
+            if (seek_target_us != AV_NOPTS_VALUE) {
+                int64_t end_us = av_rescale_q(decoded_audio_frame_->pts, fmt_ctx_->streams[audio_stream_index_]->time_base, { 1, AV_TIME_BASE }) +
+                                 decoded_audio_frame_->nb_samples * AV_TIME_BASE / decoded_audio_frame_->sample_rate;
+                if (end_us <= seek_target_us) continue;
+
+                seek_target_us = AV_NOPTS_VALUE;
+            }
+
             // decoded frame@{
             auto buffer = (uint8_t *)av_malloc(decoded_audio_frame_->nb_samples * 2 * av_get_bytes_per_sample(AV_SAMPLE_FMT_S16));
             int samples_pre_ch = swr_convert(swr_ctx_,
@@ -420,6 +868,11 @@ void MediaDecoder::audio_thread_f()
             av_free(buffer);
 
             while(ring_buffer.size() >= period_size_) {
+                // prepared: the first period waits until start()
+                while (held_ && running()) {
+                    std::this_thread::sleep_for(10ms);
+                }
+
                 if (ring_buffer.continuous_size() < period_size_) {
                     ring_buffer.defrag();
                 }
@@ -453,14 +906,43 @@ void MediaDecoder::close()
     running_ = false;
     opened_ = false;
     paused_ = false;
+    held_ = false;
 
     // wait for the threads to exit
     if(read_thread_.joinable()) read_thread_.join();
     if(video_thread_.joinable()) video_thread_.join();
+    if(present_thread_.joinable()) present_thread_.join();
     if(audio_thread_.joinable()) audio_thread_.join();
 
     first_pts_ = AV_NOPTS_VALUE;
 
+    video_finished_ = false;
+    audio_finished_ = false;
+    video_eof_serial_ = -1;
+    audio_eof_serial_ = -1;
+    read_finished_ = false;
+    seek_req_ = false;
+    serial_ = 0;
+    seek_latency_us_ = 0;
+
+    mode_ = PlaybackMode::FORWARD;
+    step_req_ = 0;
+    frame_cache_.clear();
+    current_pts_ = AV_NOPTS_VALUE;
+    pending_steps_ = 0;
+    video_eof_ = false;
+    fill_until_ = AV_NOPTS_VALUE;
+    fill_done_ = true;
+    fill_first_ = AV_NOPTS_VALUE;
+    fill_floor_ = AV_NOPTS_VALUE;
+    decoded_video_frames_ = 0;
+    decoded_audio_frames_ = 0;
+    presented_frames_ = 0;
+    dropped_frames_ = 0;
+    skip_periods_ = 0;
+    skipping_ = false;
+    late_frames_ = 0;
+
     avfilter_graph_free(&filter_graph_);
 
     av_packet_free(&packet_);
@@ -470,9 +952,17 @@ void MediaDecoder::close()
     av_frame_free(&decoded_video_frame_);
     av_frame_free(&decoded_audio_frame_);
     av_frame_free(&filtered_frame_);
+    av_frame_free(&scaled_frame_);
+
+    sws_freeContext(sws_ctx_);
+    sws_ctx_ = nullptr;
+    av_buffer_pool_uninit(&scale_pool_);
+    scale_pool_size_ = 0;
+    av_frame_free(&presented_frame_);
 
     video_packet_buffer_.clear();
     audio_packet_buffer_.clear();
+    video_frame_buffer_.clear();
 
     avcodec_free_context(&video_decoder_ctx_);
     avcodec_free_context(&audio_decoder_ctx_);
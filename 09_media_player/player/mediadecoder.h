@@ -10,6 +10,8 @@ extern "C" {
 #include <libavfilter/buffersink.h>
 #include <libavfilter/buffersrc.h>
 #include <libswresample/swresample.h>
+#include <libswscale/swscale.h>
+#include <libavutil/imgutils.h>
 }
 #include <atomic>
 #include <mutex>
@@ -18,10 +20,30 @@ extern "C" {
 #include <condition_variable>
 #include "ringvector.h"
 #include "ringbuffer.h"
+#include "framecache.h"
+#include "filter_threading.h"
 #include "defer.h"
 #include "logging.h"
 
 const int BUFFER_SIZE = 20;
+const int FRAME_BUFFER_SIZE = 8;    // filtered video frames the decoder may run ahead of the presentation
+
+struct MediaDecoderStats {
+    int64_t decoded_video_frames{ 0 };
+    int64_t decoded_audio_frames{ 0 };
+    int64_t presented_frames{ 0 };      // passed to the video callback
+    int64_t dropped_frames{ 0 };        // decoded, but too late to be presented
+    int64_t skip_periods{ 0 };          // times the decoder started skipping non-reference frames
+    bool skipping{ false };
+    int64_t seek_latency_us{ 0 };       // from the last seek() to its first presented frame
+    size_t cached_frames{ 0 };
+    size_t cached_bytes{ 0 };
+    size_t video_packets{ 0 };          // queued right now
+    size_t audio_packets{ 0 };
+    size_t video_frames{ 0 };
+};
+
+enum class PlaybackMode { FORWARD, STEPPING, REVERSE };
 
 class MediaDecoder  {
 public:
@@ -37,9 +59,23 @@ public:
     bool opened() { return opened_; }
     bool running() { return running_; }
     bool paused() { return paused_; }
+    bool prepared() { return running_ && held_; }
+    // video and audio have been played to the end of the input since the last seek, or their threads returned on an error
+    bool finished()
+    {
+        const int serial = serial_;
+        return (video_finished_ || video_eof_serial_ == serial) && (audio_finished_ || audio_eof_serial_ == serial);
+    }
 
     void start()
     {
+        // prepared: the frames and samples decoded ahead are presented and played from now on
+        if (running_ && held_) {
+            set_clock(0);
+            held_ = false;
+            return;
+        }
+
         if (!opened() || running_) {
             LOG(ERROR) << "[DECODER] already running or not opened";
             return;
@@ -49,11 +85,21 @@ public:
 
         read_thread_ = std::thread([this](){ this->read_thread_f(); });
         video_thread_ = std::thread([this](){ this->video_thread_f(); });
+        present_thread_ = std::thread([this](){ this->present_thread_f(); });
         audio_thread_ = std::thread([this](){ this->audio_thread_f(); });
     }
 
+    // starts reading and decoding, but holds the first video frame and audio period back until start(), so that
+    // the next item of a playlist is ready to go on the moment the current one ends
+    void prepare()
+    {
+        held_ = true;
+        start();
+    }
+
     void read_thread_f();
     void video_thread_f();
+    void present_thread_f();
     void audio_thread_f();
 
     int width() { return video_decoder_ctx_ ? video_decoder_ctx_->width : 480; }
@@ -61,10 +107,60 @@ public:
     AVRational sar() { return video_decoder_ctx_ ? video_decoder_ctx_->sample_aspect_ratio : AVRational{ 0, 1 }; }
     AVRational framerate() { return opened() ? av_guess_frame_rate(fmt_ctx_, fmt_ctx_->streams[video_stream_index_], nullptr) : AVRational{ 30, 1 }; }
     AVRational timebase() { return opened() ? fmt_ctx_->streams[video_stream_index_]->time_base : AVRational{ 1, AV_TIME_BASE }; }
+    int sample_rate() { return audio_decoder_ctx_ ? audio_decoder_ctx_->sample_rate : 48000; } // of the s16 stereo audio callback
+
+    MediaDecoderStats stats()
+    {
+        return {
+            decoded_video_frames_, decoded_audio_frames_, presented_frames_, dropped_frames_, skip_periods_, skipping_, seek_latency_us_,
+            frame_cache_.size(), frame_cache_.bytes(),
+            video_packet_buffer_.size(), audio_packet_buffer_.size(), video_frame_buffer_.size()
+        };
+    }
+
+    // master clock, audio if there is an audio stream, otherwise the wall clock since the first packet
+    int64_t clock_us()
+    {
+        if (audio_stream_index_ < 0) {
+            return av_gettime_relative() - first_pts_;
+        }
+        return std::max<int64_t>(0, audio_clock_ + av_gettime_relative() - audio_clock_ts_);
+    }
+
+    double clock_s()
+    {
+        return (double) clock_us() / (double) AV_TIME_BASE;
+    }
 
     void set_video_callback(std::function<void(AVFrame *)> callback) { video_callback_ = std::move(callback); }
     void set_audio_callback(std::function<std::pair<int64_t, bool>(RingBuffer&)> callback) { audio_callback_ = std::move(callback); }
     void set_period_size(size_t size) { period_size_ = size; }
+    void set_filter_threading(const FilterThreading& threading) { filter_threading_ = threading; } // before open()
+    // the frames are scaled to this size while they are converted to pix_fmt, 0x0: the size of the source
+    void set_display_size(int width, int height)
+    {
+        display_size_ = (static_cast<uint64_t>(std::max(width, 0)) << 32) | static_cast<uint32_t>(std::max(height, 0));
+    }
+    // frames later than this behind the clock are dropped, and while decoding keeps lagging by more than this
+    // the decoder skips non-reference frames; <= 0 presents every frame
+    void set_drop_threshold(int64_t us) { drop_threshold_us_ = us; }
+
+    // @ts_us from the start of the input; precise: decode forward from the keyframe and present the frame at @ts_us,
+    // otherwise present the keyframe at or before it. Also after the end of the input, the threads wait for a seek there
+    bool seek(int64_t ts_us, bool precise = false);
+
+    // frame stepping (negative: backwards) and reverse playback at 1x, served from a cache of decoded GOPs;
+    // step() stops the playback at the current frame, play_forward() resumes it from there
+    void step(int frames)
+    {
+        PlaybackMode forward = PlaybackMode::FORWARD;
+        mode_.compare_exchange_strong(forward, PlaybackMode::STEPPING);
+        step_req_ += frames;
+    }
+    void play_reverse() { mode_ = PlaybackMode::REVERSE; }
+    void play_forward() { mode_ = PlaybackMode::FORWARD; }
+    PlaybackMode mode() { return mode_; }
+    void set_frame_cache_size(size_t bytes) { frame_cache_.set_capacity(bytes); } // before start()
 
     void pause() { paused_ = true; }
     void resume() { paused_ = false; }
@@ -72,12 +168,77 @@ public:
 private:
     void close();
 
+    // filtered frame -> pix_fmt_ at the display size, in one pass
+    bool scale_frame(const AVFrame * in, AVFrame * out);
+
+    // blocks while the frame queue is full, nullptr queues the EOF marker; false if stopped
+    bool push_video_frame(AVFrame * frame, int serial);
+
+    // presentation thread, stepping and reverse playback
+    void present_cached(PlaybackMode mode);
+    void receive_frames();
+    void request_fill(int64_t until);
+    void show(AVFrame * frame);
+    int64_t pts_to_us(int64_t pts) { return av_rescale_q(pts, fmt_ctx_->streams[video_stream_index_]->time_base, { 1, AV_TIME_BASE }); }
+
+    // runs on the read thread, true if a seek has been done
+    bool do_seek();
+    // the master clock restarts at @us now
+    void set_clock(int64_t us);
+
+    // raise or restore skip_frame/skip_loop_filter according to how late the decoded frames are
+    void update_skipping(int64_t lateness_us);
+
     std::atomic<bool> running_{ false };
     std::atomic<bool> paused_{ false };
+    std::atomic<bool> held_{ false };       // prepare()d, nothing is presented or played yet
     std::atomic<bool> opened_{ false };
+    std::atomic<bool> video_finished_{ false };     // the video / audio decoding thread has returned
+    std::atomic<bool> audio_finished_{ false };
+    std::atomic<int> video_eof_serial_{ -1 };    // the serial whose last frame has been presented / audio decoded
+    std::atomic<int> audio_eof_serial_{ -1 };
+
+    std::atomic<int64_t> decoded_video_frames_{ 0 };
+    std::atomic<int64_t> decoded_audio_frames_{ 0 };
+    std::atomic<int64_t> presented_frames_{ 0 };
+    std::atomic<int64_t> dropped_frames_{ 0 };
+    std::atomic<int64_t> skip_periods_{ 0 };
+    std::atomic<bool> skipping_{ false };
+
+    std::atomic<int64_t> drop_threshold_us_{ 100'000 };
+    int late_frames_{ 0 };              // consecutive decoded frames behind by more than the threshold
+
+    // seek requests are served by the read thread; every seek starts a new serial, frames of older serials are not presented
+    std::mutex seek_mtx_;
+    bool seek_req_{ false };
+    int64_t seek_ts_{ 0 };
+    bool seek_precise_{ false };
+    std::atomic<int64_t> seek_start_us_{ 0 };
+    std::atomic<int64_t> seek_latency_us_{ 0 };
+    std::atomic<int> serial_{ 0 };
+    std::atomic<bool> read_finished_{ false };
+
+    std::atomic<PlaybackMode> mode_{ PlaybackMode::FORWARD };
+    std::atomic<int> step_req_{ 0 };
+
+    // frames that went through the presentation thread, and whole GOPs decoded for stepping backwards;
+    // everything below is owned by the presentation thread
+    FrameCache frame_cache_{ 256 * 1024 * 1024 };
+    int64_t current_pts_{ AV_NOPTS_VALUE };     // on screen, stream time base
+    int pending_steps_{ 0 };
+    int64_t reverse_due_{ 0 };
+    bool video_eof_{ false };                   // the EOF marker of the current serial has been received
+
+    // a GOP fill seeks to the keyframe before @fill_until_ and caches the frames up to it
+    int64_t fill_until_{ AV_NOPTS_VALUE };
+    int fill_serial_{ 0 };
+    bool fill_done_{ true };
+    int64_t fill_first_{ AV_NOPTS_VALUE };
+    int64_t fill_floor_{ AV_NOPTS_VALUE };      // oldest frame of the last completed fill still in the cache
 
     std::thread read_thread_;
     std::thread video_thread_;
+    std::thread present_thread_;
     std::thread audio_thread_;
 
     AVFormatContext* fmt_ctx_{ nullptr };
@@ -96,26 +257,20 @@ private:
     AVFrame* decoded_video_frame_{ nullptr };
     AVFrame* decoded_audio_frame_{ nullptr };
     AVFrame* filtered_frame_{ nullptr };
+    AVFrame* scaled_frame_{ nullptr };
+    AVFrame* presented_frame_{ nullptr };
 
     SwrContext * swr_ctx_{ nullptr };
 
+    std::atomic<uint64_t> display_size_{ 0 };   // width << 32 | height
+    SwsContext * sws_ctx_{ nullptr };
+    AVBufferPool * scale_pool_{ nullptr };
+    int scale_pool_size_{ 0 };
+
     int64_t first_pts_{ AV_NOPTS_VALUE };
     std::atomic<int64_t> audio_clock_{ 0 }; // { 1, AV_TIME_BASE } unit
     std::atomic<int64_t> audio_clock_ts_{ 0 };
 
-    int64_t clock_us()
-    {
-        if (audio_stream_index_ < 0) {
-            return av_gettime_relative() - first_pts_;
-        }
-        return std::max<int64_t>(0, audio_clock_ + av_gettime_relative() - audio_clock_ts_);
-    }
-
-    double clock_s()
-    {
-        return (double) clock_us() / (double) AV_TIME_BASE;
-    }
-
     RingVector<AVPacket*, BUFFER_SIZE> video_packet_buffer_{
             []() { return av_packet_alloc(); },
             [](AVPacket** packet) { av_packet_free(packet); }
@@ -126,12 +281,19 @@ private:
             [](AVPacket** packet) { av_packet_free(packet); }
     };
 
+    // decode/filter thread -> presentation thread, EOF: width = height = 0
+    RingVector<AVFrame*, FRAME_BUFFER_SIZE> video_frame_buffer_{
+            []() { return av_frame_alloc(); },
+            [](AVFrame** frame) { av_frame_free(frame); }
+    };
+
     size_t period_size_{ 4096 * 2 };
 
     std::function<void(AVFrame *)> video_callback_{ [](AVFrame *){ } };
     std::function<std::pair<int64_t, bool>(RingBuffer&)> audio_callback_{ [](RingBuffer&) { return std::pair{0, false}; } };
 
     std::string filters_descr_;
+    FilterThreading filter_threading_{};
     AVFilterGraph* filter_graph_{ nullptr };
     AVFilterContext* buffersrc_ctx_{ nullptr };
     AVFilterContext* buffersink_ctx_{ nullptr };
@@ -0,0 +1,51 @@
+#include "playlist.h"
+#include "fmt/format.h"
+
+bool Playlist::open()
+{
+    if (files_.empty()) return false;
+
+    prefetch(0);
+    return advance();
+}
+
+void Playlist::prefetch(size_t idx)
+{
+    auto decoder = std::make_unique<MediaDecoder>();
+    setup_(*decoder);
+
+    next_index_ = idx;
+    next_ = std::async(std::launch::async, [this, name = files_[idx], decoder = std::move(decoder)]() mutable {
+        if (!decoder->open(name, format_, filters_, pix_fmt_, {})) {
+            LOG(ERROR) << "[PLAYLIST] failed to open " << name << ", skipped";
+            return std::unique_ptr<MediaDecoder>{};
+        }
+        // decodes until the queues are full, then waits for start()
+        decoder->prepare();
+        return std::move(decoder);
+    });
+}
+
+bool Playlist::advance()
+{
+    while (next_.valid()) {
+        const int64_t t0 = av_gettime_relative();
+        auto next = next_.get();
+        const size_t idx = next_index_;
+
+        if (idx + 1 < files_.size()) {
+            prefetch(idx + 1);
+        }
+
+        if (next) {
+            // the new item goes first, closing the old one joins its threads
+            next->start();
+            current_ = std::move(next);
+            index_ = idx;
+
+            LOG(INFO) << fmt::format("[PLAYLIST] #{} {}, waited {} us for the prefetch", index_, files_[index_], av_gettime_relative() - t0);
+            return true;
+        }
+    }
+    return false;
+}
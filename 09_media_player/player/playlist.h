@@ -0,0 +1,52 @@
+#ifndef PLAYER_PLAYLIST
+#define PLAYER_PLAYLIST
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mediadecoder.h"
+
+// plays the items back to back: while one item is playing, the next one is opened, probed and decoded until
+// its packet and frame queues are full in the background (MediaDecoder::prepare()), so advance() only has to
+// let it go
+class Playlist {
+public:
+    // called on the thread of open()/advance() for every decoder before it is opened: callbacks, period size, ...
+    using Setup = std::function<void(MediaDecoder&)>;
+
+    Playlist(std::vector<std::string> files, std::string format, std::string filters, AVPixelFormat pix_fmt, Setup setup)
+        : files_(std::move(files)), format_(std::move(format)), filters_(std::move(filters)), pix_fmt_(pix_fmt), setup_(std::move(setup))
+    {}
+    Playlist(const Playlist&) = delete;
+    Playlist& operator=(const Playlist&) = delete;
+
+    // starts the first playable item and prefetches the one after it
+    bool open();
+
+    // starts the next playable item and closes the current one, false if there is none
+    bool advance();
+    bool has_next() const { return next_.valid(); }
+
+    MediaDecoder * current() const { return current_.get(); }
+    size_t index() const { return index_; }
+    const std::string& name() const { return files_[index_]; }
+
+private:
+    void prefetch(size_t idx);
+
+    std::vector<std::string> files_;
+    std::string format_;
+    std::string filters_;
+    AVPixelFormat pix_fmt_;
+    Setup setup_;
+
+    std::unique_ptr<MediaDecoder> current_;
+    size_t index_{ 0 };
+
+    std::future<std::unique_ptr<MediaDecoder>> next_;
+    size_t next_index_{ 0 };
+};
+
+#endif //!PLAYER_PLAYLIST
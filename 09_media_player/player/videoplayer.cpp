@@ -1,6 +1,7 @@
 #include "videoplayer.h"
 #include "ringbuffer.h"
 #include <QMessageBox>
+#include <QKeyEvent>
 
 VideoPlayer::VideoPlayer(QWidget* parent)
         : QWidget(parent)
@@ -9,11 +10,16 @@ VideoPlayer::VideoPlayer(QWidget* parent)
 
     frame_ = av_frame_alloc();
 
-    decoder_ = std::make_unique<MediaDecoder>();
-
     audio_player_ = new AudioPlayer(this);
 
-    decoder_->set_video_callback([=, this](AVFrame * frame) {
+    connect(&advance_timer_, &QTimer::timeout, this, &VideoPlayer::advance);
+
+    resize(640, 480);
+}
+
+void VideoPlayer::setup(MediaDecoder& decoder)
+{
+    decoder.set_video_callback([=, this](AVFrame * frame) {
         mtx_.lock();
         if(frame_) {
             av_frame_unref(frame_);
@@ -24,14 +30,13 @@ VideoPlayer::VideoPlayer(QWidget* parent)
         QWidget::update();
     });
 
-    decoder_->set_audio_callback([=, this](RingBuffer& buffer) -> std::pair<int64_t, bool> {
+    // a period at a time, and what is left of it at the end of the input
+    decoder.set_audio_callback([=, this](RingBuffer& buffer) -> std::pair<int64_t, bool> {
         bool ok = false;
 
-        if ((buffer.continuous_size() >= static_cast<size_t>(audio_player_->period_size())) &&
-            audio_player_->buffer_free_size() >= audio_player_->period_size()) {
-
-            size_t read_size = audio_player_->period_size();
-            audio_player_->write(buffer.read_ptr(read_size), audio_player_->period_size());
+        size_t read_size = std::min<size_t>(buffer.continuous_size(), audio_player_->period_size());
+        if (read_size > 0 && audio_player_->buffer_free_size() >= audio_player_->period_size()) {
+            audio_player_->write(buffer.read_ptr(read_size), static_cast<int64_t>(read_size));
 
             ok = true;
         }
@@ -39,31 +44,66 @@ VideoPlayer::VideoPlayer(QWidget* parent)
         return std::pair{ audio_player_->buffered_size(), ok };
     });
 
-    resize(640, 480);
+    decoder.set_period_size(audio_player_->period_size());
+    decoder.set_display_size(static_cast<int>(width() * devicePixelRatioF()), static_cast<int>(height() * devicePixelRatioF()));
 }
 
-bool VideoPlayer::play(const std::string& name, const std::string& fmt, const std::string& filter_descr)
+bool VideoPlayer::play(const std::vector<std::string>& names, const std::string& fmt, const std::string& filter_descr)
 {
-    if (!decoder_->open(name, fmt, filter_descr, AV_PIX_FMT_BGRA, {})) {
-        QMessageBox::warning(this, "Error", QString::fromStdString({"Open " + name + " failed!"}));
-        return false;
-    }
-
     if (audio_player_->open(48000, 2, 16) != 0) {
         QMessageBox::warning(this, "Error", QString::fromStdString({"Not supported audio format!"}));
         return false;
     }
 
-    decoder_->set_period_size(audio_player_->period_size());
+    playlist_ = std::make_unique<Playlist>(names, fmt, filter_descr, AV_PIX_FMT_BGRA, [this](MediaDecoder& decoder) { setup(decoder); });
+    if (!playlist_->open()) {
+        QMessageBox::warning(this, "Error", QString::fromStdString({"Open " + names.front() + " failed!"}));
+        return false;
+    }
 
-    resize((decoder_->width() > 1440 || decoder_->height() > 810) ?
-           QSize(decoder_->width(), decoder_->height()).scaled(1440, 810, Qt::KeepAspectRatio) :
-           QSize( decoder_->width(), decoder_->height())
+    resize((decoder()->width() > 1440 || decoder()->height() > 810) ?
+           QSize(decoder()->width(), decoder()->height()).scaled(1440, 810, Qt::KeepAspectRatio) :
+           QSize( decoder()->width(), decoder()->height())
     );
 
-    decoder_->start();
+    decoder()->set_display_size(static_cast<int>(width() * devicePixelRatioF()), static_cast<int>(height() * devicePixelRatioF()));
 
-    QWidget::setWindowTitle(QString::fromStdString(name));
+    QWidget::setWindowTitle(QString::fromStdString(playlist_->name()));
 
+    advance_timer_.start(10);
     return true;
 }
+
+void VideoPlayer::advance()
+{
+    // the last frame of the current item has been shown and the audio device is down to its last periods; the next
+    // item has its first frames and period decoded already, so its samples follow the buffered ones without a gap
+    if (!playlist_ || !playlist_->has_next() || !decoder()->finished() ||
+        audio_player_->buffered_size() > 2 * audio_player_->period_size()) {
+        return;
+    }
+
+    if (!playlist_->advance()) {
+        advance_timer_.stop();
+        return;
+    }
+
+    decoder()->set_display_size(static_cast<int>(width() * devicePixelRatioF()), static_cast<int>(height() * devicePixelRatioF()));
+    QWidget::setWindowTitle(QString::fromStdString(playlist_->name()));
+}
+
+void VideoPlayer::keyPressEvent(QKeyEvent * event)
+{
+    if (!decoder()) {
+        QWidget::keyPressEvent(event);
+        return;
+    }
+
+    switch (event->key()) {
+    case Qt::Key_Left:  decoder()->step(-1);         break;
+    case Qt::Key_Right: decoder()->step(1);          break;
+    case Qt::Key_R:     decoder()->play_reverse();   break;
+    case Qt::Key_Space: decoder()->play_forward();   break;
+    default:            QWidget::keyPressEvent(event);
+    }
+}
@@ -4,7 +4,9 @@
 #include <QWidget>
 #include <QPainter>
 #include <QImage>
+#include <QTimer>
 #include "mediadecoder.h"
+#include "playlist.h"
 #include "logging.h"
 #include "fmt/format.h"
 #include "audioplayer.h"
@@ -16,24 +18,43 @@ public:
     explicit VideoPlayer(QWidget* parent = nullptr);
     ~VideoPlayer() override { av_frame_free(&frame_); };
 
-    bool play(const std::string& name, const std::string& fmt = "", const std::string& filter_descr = "");
+    // the inputs are played back to back, without a gap
+    bool play(const std::vector<std::string>& names, const std::string& fmt = "", const std::string& filter_descr = "");
 
 protected:
+    void keyPressEvent(QKeyEvent * event) override;
+
+    // the decoder scales to the size of the widget in device pixels, so the painter only has to copy
+    void resizeEvent(QResizeEvent * event) override
+    {
+        if (decoder()) decoder()->set_display_size(static_cast<int>(width() * devicePixelRatioF()), static_cast<int>(height() * devicePixelRatioF()));
+        QWidget::resizeEvent(event);
+    }
+
     void paintEvent(QPaintEvent*) override
     {
         std::lock_guard lock(mtx_);
 
         if(frame_ && frame_->format == AV_PIX_FMT_BGRA) {
             QPainter painter(this);
-            painter.drawImage(rect(), QImage(static_cast<const uchar*>(frame_->data[0]), frame_->width, frame_->height, QImage::Format_ARGB32));
+            painter.drawImage(rect(), QImage(static_cast<const uchar*>(frame_->data[0]), frame_->width, frame_->height, frame_->linesize[0], QImage::Format_ARGB32));
         }
     }
 
-    std::unique_ptr<MediaDecoder> decoder_{ nullptr };
+    MediaDecoder * decoder() { return playlist_ ? playlist_->current() : nullptr; }
+
+    // callbacks and sizes of every item of the playlist
+    void setup(MediaDecoder& decoder);
+
+    // moves on to the next item once the current one has ended
+    void advance();
+
+    std::unique_ptr<Playlist> playlist_{ nullptr };
+    QTimer advance_timer_;
     AudioPlayer * audio_player_{nullptr};
 
     AVFrame *frame_{ nullptr };
     std::mutex mtx_;
 };
 
-#endif // !PLAYER_VIDEO_PLAYER_H
\ No newline at end of file
+#endif // !PLAYER_VIDEO_PLAYER_H
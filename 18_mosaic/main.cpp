@@ -0,0 +1,288 @@
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include "encoder.h"
+#include "decoder.h"
+#include "threadpool.h"
+
+extern "C" {
+#include <libswscale/swscale.h>
+#include <libavutil/imgutils.h>
+}
+
+// one cell of the wall: an input with its own decoder thread, scaled into a fixed region of the canvas
+struct Tile {
+    Tile() = default;
+    Tile(const Tile&) = delete;
+    Tile& operator=(const Tile&) = delete;
+
+    ~Tile()
+    {
+        sws_freeContext(sws_ctx_);
+        av_frame_free(&current_);
+        av_frame_free(&pending_);
+    }
+
+    // seconds since the first frame of this input
+    double time_of(const AVFrame * frame) const
+    {
+        return (frame->best_effort_timestamp - first_pts_) * av_q2d(time_base_);
+    }
+
+    std::shared_ptr<Decoder> decoder_;
+    std::thread thread_;
+
+    int x_{0}, y_{0}, w_{0}, h_{0};
+    AVRational time_base_{1, 1};
+    int64_t first_pts_{AV_NOPTS_VALUE};
+
+    AVFrame * current_{av_frame_alloc()};   // shown on the wall
+    AVFrame * pending_{av_frame_alloc()};   // popped, but not due yet
+    bool has_current_{false};
+    bool has_pending_{false};
+    bool eof_{false};
+    bool stalled_{false};
+
+    SwsContext * sws_ctx_{nullptr};
+    int64_t drawn_gen_{-1};                  // canvas generation that already holds current_
+
+    int64_t dropped_{0};
+    int64_t duplicated_{0};
+};
+
+// bring the tile up to the output time @t, waiting on the decoder no longer than @deadline.
+// frames that were superseded before they could be shown are dropped, a tile without a new frame repeats the last one.
+static bool advance(Tile& tile, double t, int64_t deadline)
+{
+    bool updated = false;
+    while (true) {
+        if (tile.has_pending_) {
+            if (tile.time_of(tile.pending_) > t) break;
+
+            if (updated) tile.dropped_++;
+            av_frame_unref(tile.current_);
+            av_frame_move_ref(tile.current_, tile.pending_);
+            tile.has_pending_ = false;
+            tile.has_current_ = true;
+            updated = true;
+            continue;
+        }
+
+        if (tile.eof_) break;
+
+        // a stalled input is only polled, so one dead camera can not hold back the whole wall
+        auto& buffer = tile.decoder_->video_frame_buffer_;
+        int64_t timeout = tile.stalled_ ? 0 : std::max<int64_t>(deadline - av_gettime_relative(), 0);
+        if (!buffer.wait_not_empty(std::chrono::microseconds(timeout))) {
+            tile.stalled_ = timeout > 0 || tile.stalled_;
+            break;
+        }
+        tile.stalled_ = false;
+
+        buffer.pop([&](AVFrame * popped) {
+            av_frame_unref(tile.pending_);
+            av_frame_move_ref(tile.pending_, popped);
+        });
+
+        if (!tile.pending_->width && !tile.pending_->height) {
+            tile.eof_ = true;
+            break;
+        }
+
+        if (tile.first_pts_ == AV_NOPTS_VALUE) tile.first_pts_ = tile.pending_->best_effort_timestamp;
+        tile.has_pending_ = true;
+    }
+
+    if (!updated && tile.has_current_) tile.duplicated_++;
+    return updated;
+}
+
+// scale the current frame of the tile straight into its region of the canvas
+static void draw(Tile& tile, AVFrame * canvas)
+{
+    auto frame = tile.current_;
+    tile.sws_ctx_ = sws_getCachedContext(tile.sws_ctx_,
+                                         frame->width, frame->height, static_cast<AVPixelFormat>(frame->format),
+                                         tile.w_, tile.h_, static_cast<AVPixelFormat>(canvas->format),
+                                         SWS_BILINEAR, nullptr, nullptr, nullptr);
+    CHECK_NOTNULL(tile.sws_ctx_);
+
+    // yuv420p: chroma planes are subsampled by 2 in both directions, x/y/w/h are even
+    uint8_t * dst[4] = {
+            canvas->data[0] + tile.y_ * canvas->linesize[0] + tile.x_,
+            canvas->data[1] + tile.y_ / 2 * canvas->linesize[1] + tile.x_ / 2,
+            canvas->data[2] + tile.y_ / 2 * canvas->linesize[2] + tile.x_ / 2,
+            nullptr
+    };
+    sws_scale(tile.sws_ctx_, frame->data, frame->linesize, 0, frame->height, dst, canvas->linesize);
+}
+
+int main(int argc, char* argv[])
+{
+    const char * usage = "mosaic -i <input-1> -i <input-2> [-i <input-n>] [-size <w>x<h>] [-cols <n>] [-r <fps>] "
+                         "[-t <seconds>] [-stall_ms <ms>] [-realtime] <output>";
+    if (argc < 4) {
+        LOG(ERROR) << usage;
+        return -1;
+    }
+
+    std::vector<std::string> input_files;
+    std::string output_file;
+    int width = 1920, height = 1080;
+    int cols = 0;
+    double fps = 25;
+    double duration = 0;
+    int stall_ms = 200;
+    bool realtime = false;
+
+    for (int i = 1; i < argc; i++){
+        if (std::strcmp("-i", argv[i]) == 0 && i + 1 < argc && argv[i+1][0] != '-') {
+            input_files.emplace_back(argv[++i]);
+        }
+        else if (std::strcmp("-size", argv[i]) == 0 && i + 1 < argc) {
+            CHECK(std::sscanf(argv[++i], "%dx%d", &width, &height) == 2) << usage;
+        }
+        else if (std::strcmp("-cols", argv[i]) == 0 && i + 1 < argc) {
+            cols = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp("-r", argv[i]) == 0 && i + 1 < argc) {
+            fps = std::atof(argv[++i]);
+        }
+        else if (std::strcmp("-t", argv[i]) == 0 && i + 1 < argc) {
+            duration = std::atof(argv[++i]);
+        }
+        else if (std::strcmp("-stall_ms", argv[i]) == 0 && i + 1 < argc) {
+            stall_ms = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp("-realtime", argv[i]) == 0) {
+            realtime = true;
+        }
+        else if (output_file.empty()){
+            output_file = argv[i];
+        }
+        else {
+            LOG(ERROR) << usage;
+            return -1;
+        }
+    }
+
+    const int nb_inputs = static_cast<int>(input_files.size());
+    CHECK(nb_inputs >= 1 && nb_inputs <= 64 && !output_file.empty() && fps > 0) << usage;
+
+    // layout: a cols x rows grid of equal, even sized tiles
+    if (cols <= 0) cols = static_cast<int>(std::ceil(std::sqrt(nb_inputs)));
+    cols = std::min(cols, nb_inputs);
+    const int rows = (nb_inputs + cols - 1) / cols;
+    const int tile_w = (width / cols) & ~1;
+    const int tile_h = (height / rows) & ~1;
+    CHECK(tile_w > 0 && tile_h > 0) << "the output is too small for " << nb_inputs << " tiles";
+
+    std::vector<std::unique_ptr<Tile>> tiles;
+    for (int i = 0; i < nb_inputs; i++) {
+        auto tile = std::make_unique<Tile>();
+        tile->decoder_ = std::make_shared<Decoder>();
+        CHECK(tile->decoder_->open(input_files[i]) >= 0);
+        tile->time_base_ = tile->decoder_->fmt_ctx_->streams[tile->decoder_->video_stream_idx_]->time_base;
+        tile->x_ = (i % cols) * tile_w;
+        tile->y_ = (i / cols) * tile_h;
+        tile->w_ = tile_w;
+        tile->h_ = tile_h;
+        tiles.push_back(std::move(tile));
+    }
+
+    LOG(INFO) << fmt::format("[MOSAIC] {} inputs, {}x{} grid of {}x{} tiles, output {}x{} @ {} fps{}",
+                             nb_inputs, cols, rows, tile_w, tile_h, width, height, fps, realtime ? ", realtime" : "");
+
+    // open output file
+    const AVRational framerate = av_d2q(fps, 100000);
+    Encoder encoder;
+    encoder.open(output_file, width, height, AV_PIX_FMT_YUV420P, {1, 1}, framerate, av_inv_q(framerate));
+
+    for (auto& tile : tiles) {
+        auto decoder = tile->decoder_;
+        tile->thread_ = std::thread([decoder](){ decoder->running_ = true; decoder->decode_thread(); });
+    }
+
+    ThreadPool pool;
+
+    // the canvas is reused while the encoder holds no reference to it, otherwise a new one is allocated;
+    // the generation tells whether a tile still has its current frame in the canvas
+    AVFrame * canvas = av_frame_alloc();
+    int64_t canvas_gen = 0;
+    std::vector<int> dirty;
+
+    const int64_t interval = static_cast<int64_t>(1000000 / fps);
+    const int64_t start = av_gettime_relative();
+    int64_t compose_us = 0;
+    int64_t ticks = 0;
+
+    for (; duration <= 0 || ticks / fps < duration; ticks++) {
+        const double t = ticks / fps;
+
+        // realtime: the tick is due at a fixed wall-clock time; otherwise give each tick a fixed budget for late inputs
+        const int64_t deadline = realtime ? start + (ticks + 1) * interval : av_gettime_relative() + stall_ms * 1000;
+        bool finished = true;
+        for (auto& tile : tiles) {
+            if (advance(*tile, t + 0.5 / fps, deadline)) tile->drawn_gen_ = -1;
+            finished &= tile->eof_ && !tile->has_pending_;
+        }
+        if (finished) break;
+
+        if (realtime && deadline > av_gettime_relative()) {
+            av_usleep(static_cast<unsigned>(deadline - av_gettime_relative()));
+        }
+
+        int64_t t0 = av_gettime_relative();
+        if (!av_frame_is_writable(canvas)) {
+            av_frame_unref(canvas);
+            canvas->format = AV_PIX_FMT_YUV420P;
+            canvas->width = width;
+            canvas->height = height;
+            CHECK(av_frame_get_buffer(canvas, 0) >= 0);
+
+            ptrdiff_t linesizes[4] = { canvas->linesize[0], canvas->linesize[1], canvas->linesize[2], 0 };
+            av_image_fill_black(canvas->data, linesizes, AV_PIX_FMT_YUV420P, AVCOL_RANGE_MPEG, width, height);
+            canvas_gen++;
+        }
+
+        dirty.clear();
+        for (int i = 0; i < nb_inputs; i++) {
+            if (tiles[i]->has_current_ && tiles[i]->drawn_gen_ != canvas_gen) dirty.push_back(i);
+        }
+
+        // the tiles are disjoint and each has its own scaler, so they are scaled in parallel
+        pool.parallel_for(static_cast<int>(dirty.size()), [&](int j) {
+            draw(*tiles[dirty[j]], canvas);
+            tiles[dirty[j]]->drawn_gen_ = canvas_gen;
+        });
+        compose_us += av_gettime_relative() - t0;
+
+        canvas->pts = ticks;
+        encoder.encode_frame(canvas);
+    }
+
+    // flush the encoder
+    av_frame_unref(canvas);
+    encoder.encode_frame(canvas);
+
+    LOG(INFO) << fmt::format("[MOSAIC] {} frames, {:.3f} ms/frame compositing", ticks, ticks ? compose_us / 1000.0 / ticks : 0.0);
+    for (int i = 0; i < nb_inputs; i++) {
+        LOG(INFO) << fmt::format("[MOSAIC] #{} {}: dropped = {}, duplicated = {}{}",
+                                 i, input_files[i], tiles[i]->dropped_, tiles[i]->duplicated_, tiles[i]->stalled_ ? ", stalled" : "");
+    }
+
+    for (auto& tile : tiles) {
+        tile->decoder_->running_ = false;
+    }
+
+    for (auto& tile : tiles) {
+        if (tile->thread_.joinable()) {
+            tile->thread_.join();
+        }
+    }
+
+    av_frame_free(&canvas);
+
+    LOG(INFO) << "EXITED";
+    return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef FFMPEG_EXAMPLES_FILTER_THREADING_H
+#define FFMPEG_EXAMPLES_FILTER_THREADING_H
+
+extern "C" {
+#include <libavfilter/avfilter.h>
+}
+
+#include "threadpool.h"
+
+// Slice threading of an AVFilterGraph (scale, overlay, ... split each frame into slices).
+// apply() must be called right after avfilter_graph_alloc(), before the first filter is created.
+struct FilterThreading {
+    int nb_threads{ 0 };                            // 0: one per cpu, 1: single threaded
+    int thread_type{ AVFILTER_THREAD_SLICE };       // 0 disables threading
+    ThreadPool * pool{ nullptr };                   // run the slices on a shared pool instead of libavfilter's own threads
+
+    void apply(AVFilterGraph * graph) const
+    {
+        if (!graph) return;
+
+        graph->thread_type = thread_type;
+        graph->nb_threads = nb_threads;
+
+        if (pool && thread_type) {
+            // the caller runs slices too
+            if (graph->nb_threads <= 0) graph->nb_threads = static_cast<int>(pool->size()) + 1;
+            graph->opaque = pool;
+            graph->execute = execute;
+        }
+    }
+
+    static int execute(AVFilterContext * ctx, avfilter_action_func * func, void * arg, int * ret, int nb_jobs)
+    {
+        auto pool = static_cast<ThreadPool *>(ctx->graph->opaque);
+        pool->parallel_for(nb_jobs, [&](int job) {
+            int r = func(ctx, arg, job, nb_jobs);
+            if (ret) ret[job] = r;
+        });
+        return 0;
+    }
+};
+
+#endif // !FFMPEG_EXAMPLES_FILTER_THREADING_H
@@ -2,7 +2,9 @@
 #define FFMPEG_EXAMPLES_RING_VECTOR_H
 
 #include <mutex>
+#include <chrono>
 #include <functional>
+#include <condition_variable>
 
 #define EMPTY (!full_ && (pushed_idx_ == popped_idx_))
 
@@ -28,7 +30,7 @@ public:
 
     void push(std::function<void(T)> callback)
     {
-        std::lock_guard<std::mutex> lock(mtx_);
+        std::unique_lock<std::mutex> lock(mtx_);
 
         // last one
         // 
@@ -49,11 +51,14 @@ public:
         callback(buffer_[pushed_idx_]);
 
         pushed_idx_ = (pushed_idx_ + 1) % N;
+
+        lock.unlock();
+        not_empty_.notify_all();
     }
 
     void pop(std::function<void(T)> callback = [](T) {})
     {
-        std::lock_guard<std::mutex> lock(mtx_);
+        std::unique_lock<std::mutex> lock(mtx_);
 
         // empty ? last : next
         callback(EMPTY ? buffer_[(popped_idx_ + N - 1) % N] : buffer_[popped_idx_]);
@@ -64,14 +69,36 @@ public:
         }
 
         full_ = false;
+
+        lock.unlock();
+        not_full_.notify_all();
     }
 
     void clear()
     {
-        std::lock_guard<std::mutex> lock(mtx_);
+        std::unique_lock<std::mutex> lock(mtx_);
         popped_idx_ = 0;
         pushed_idx_ = 0;
         full_ = false;
+
+        lock.unlock();
+        not_full_.notify_all();
+    }
+
+    // block until a frame can be popped or the timeout expires, returns !empty()
+    template<class Rep, class Period>
+    bool wait_not_empty(const std::chrono::duration<Rep, Period>& timeout) const
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        return not_empty_.wait_for(lock, timeout, [this]() { return !EMPTY; });
+    }
+
+    // block until a push would not overwrite the oldest one or the timeout expires, returns !full()
+    template<class Rep, class Period>
+    bool wait_not_full(const std::chrono::duration<Rep, Period>& timeout) const
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        return not_full_.wait_for(lock, timeout, [this]() { return !full_; });
     }
 
     bool empty() const
@@ -105,6 +132,8 @@ private:
 
     T buffer_[N]{};
     mutable std::mutex mtx_;
+    mutable std::condition_variable not_empty_;
+    mutable std::condition_variable not_full_;
 };
 #undef EMPTY
 #endif // !FFMPEG_EXAMPLES_RING_VECTOR_H
\ No newline at end of file
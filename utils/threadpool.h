@@ -0,0 +1,127 @@
+#ifndef FFMPEG_EXAMPLES_THREAD_POOL_H
+#define FFMPEG_EXAMPLES_THREAD_POOL_H
+
+#include <thread>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <future>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <condition_variable>
+
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads = std::thread::hardware_concurrency())
+    {
+        threads = std::max<size_t>(threads, 1);
+        for (size_t i = 0; i < threads; i++) {
+            workers_.emplace_back([this]() { worker_f(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            running_ = false;
+        }
+        cv_.notify_all();
+
+        for (auto& worker : workers_) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+    }
+
+    size_t size() const { return workers_.size(); }
+
+    template<class F>
+    auto submit(F&& f) -> std::future<decltype(f())>
+    {
+        auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::forward<F>(f));
+        auto future = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            tasks_.emplace_back([task]() { (*task)(); });
+        }
+        cv_.notify_one();
+        return future;
+    }
+
+    // run fn(job) for every job in [0, nb_jobs) and return when all are done.
+    // The caller takes jobs as well, so this never deadlocks when called from a pool thread.
+    void parallel_for(int nb_jobs, const std::function<void(int)>& fn)
+    {
+        if (nb_jobs <= 0) return;
+
+        struct State {
+            std::atomic<int> next{ 0 };
+            int done{ 0 };
+            std::mutex mtx;
+            std::condition_variable cv;
+        };
+        auto state = std::make_shared<State>();
+        const int nb_jobs_ = nb_jobs;
+
+        // helpers may start after all jobs are gone, so they share the state instead of the caller's stack;
+        // fn is only called for a claimed job, i.e. while the caller is still waiting
+        auto run = [state, nb_jobs_, &fn]() {
+            int finished = 0;
+            for (int job = state->next++; job < nb_jobs_; job = state->next++) {
+                fn(job);
+                finished++;
+            }
+            if (finished > 0) {
+                std::lock_guard<std::mutex> lock(state->mtx);
+                state->done += finished;
+                if (state->done == nb_jobs_) state->cv.notify_all();
+            }
+        };
+
+        const size_t helpers = std::min<size_t>(workers_.size(), nb_jobs - 1);
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            for (size_t i = 0; i < helpers; i++) {
+                tasks_.emplace_back(run);
+            }
+        }
+        cv_.notify_all();
+
+        run();
+
+        std::unique_lock<std::mutex> lock(state->mtx);
+        state->cv.wait(lock, [&]() { return state->done == nb_jobs_; });
+    }
+
+private:
+    void worker_f()
+    {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                cv_.wait(lock, [this]() { return !running_ || !tasks_.empty(); });
+                if (!running_ && tasks_.empty()) return;
+
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers_{};
+    std::deque<std::function<void()>> tasks_{};
+    std::mutex mtx_{};
+    std::condition_variable cv_{};
+    bool running_{ true };
+};
+
+#endif // !FFMPEG_EXAMPLES_THREAD_POOL_H